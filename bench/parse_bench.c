@@ -0,0 +1,188 @@
+/* parse_bench.c: Times parse_cmd() on "rm block" lines against the number
+ * of ids they hold, next to the parse_id_list() it replaced (a copy of the
+ * line to count the tokens, a fresh malloc'd list for every command, then
+ * _strsep(), _isnumeric() and strtol() on each token), run on the same
+ * lines. Both copy each line first, since parsing writes into it.
+ *
+ * A second table times parse_uint32() against strtol() on ids of a given
+ * number of digits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/commands.h"
+#include "../src/parse.h"
+#include "../src/utils/_stdlib.h"
+#include "../src/utils/_string.h"
+#include "../src/utils/decimal.h"
+
+#define MIN_NUM_IDS 4
+#define MAX_NUM_IDS 4096
+// Ids parsed per timing, whatever the number of ids per line.
+#define IDS_PER_RUN 4000000
+#define MAX_DIGITS 10
+#define NUM_TOKENS 1000000
+
+static void time_id_lists();
+static void time_decimals();
+static char *make_line(size_t num_ids);
+static double time_naive_parse(const char *line, size_t length, size_t repeats);
+static void naive_parse_id_list(Command *command, char **line);
+static double time_parse_cmd(const char *line, size_t length, size_t repeats);
+static double time_strtol(const char *tokens, size_t num_digits);
+static double time_parse_uint32(const char *tokens, size_t num_digits);
+static double elapsed_ms(const struct timespec *start);
+
+static volatile unsigned long sink;
+
+int main()
+{
+    time_id_lists();
+    puts("");
+    time_decimals();
+    return EXIT_SUCCESS;
+}
+
+void time_id_lists()
+{
+    printf("%-16s%-16s%s\n", "ids_per_line", "naive_ms", "parse_cmd_ms");
+    for (size_t num_ids = MIN_NUM_IDS; num_ids <= MAX_NUM_IDS; num_ids *= 4) {
+        char *line = make_line(num_ids);
+        size_t length = strlen(line);
+        size_t repeats = IDS_PER_RUN / num_ids;
+        printf("%-16zu", num_ids);
+        printf("%-16.2f", time_naive_parse(line, length, repeats));
+        printf("%.2f\n", time_parse_cmd(line, length, repeats));
+        free(line);
+    }
+}
+
+void time_decimals()
+{
+    printf("%-16s%-16s%s\n", "digits", "strtol_ms", "parse_uint32_ms");
+    char *tokens = malloc(NUM_TOKENS * (MAX_DIGITS + 1));
+    srand(1);
+    for (size_t num_digits = 1; num_digits <= MAX_DIGITS; num_digits++) {
+        for (size_t i = 0; i < NUM_TOKENS; i++) {
+            char *token = &tokens[i * (num_digits + 1)];
+            for (size_t j = 0; j < num_digits; j++) {
+                // Keeps ten digit ids below UINT32_MAX.
+                token[j] = '0' + rand() % (j || num_digits < MAX_DIGITS ? 10 : 4);
+            }
+            token[num_digits] = '\0';
+        }
+        printf("%-16zu", num_digits);
+        printf("%-16.2f", time_strtol(tokens, num_digits));
+        printf("%.2f\n", time_parse_uint32(tokens, num_digits));
+    }
+    free(tokens);
+}
+
+char *make_line(size_t num_ids)
+{
+    char *line = malloc(16 + num_ids * (MAX_DIGITS + 1));
+    size_t length = sprintf(line, "rm block");
+    for (size_t i = 0; i < num_ids; i++) {
+        length += sprintf(&line[length], " %u", (unsigned int) rand());
+    }
+    return line;
+}
+
+double time_naive_parse(const char *line, size_t length, size_t repeats)
+{
+    char *copy = malloc(length + 1);
+    Command command = { .maincmd = UNDEFINED };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < repeats; i++) {
+        memcpy(copy, line, length + 1);
+        char *rest = copy;
+        char delim = ' ';
+        _strsep(&rest, &delim);
+        _strsep(&rest, &delim);
+        command.bidcount = 0;
+        naive_parse_id_list(&command, &rest);
+        sink += command.bidcount;
+        free(command.bidlist);
+    }
+    double ms = elapsed_ms(&start);
+    free(copy);
+    return ms;
+}
+
+void naive_parse_id_list(Command *command, char **line)
+{
+    char delim = ' ';
+    int tokencount = 0;
+    char cpyline[_strlen(*line) + 1];
+    _strcpy(cpyline, *line);
+    char *cpyptr = cpyline;
+    while (_strsep(&cpyptr, &delim)) {
+        tokencount++;
+    }
+    command->bidlist = malloc(sizeof(unsigned int) * tokencount);
+    size_t bidcount = 0;
+    for (int i = 0; i < tokencount; i++) {
+        char *token = _strsep(line, &delim);
+        if (!_strcmp("*", token)) {
+            command->all = true;
+            continue;
+        }
+        if (!_isnumeric(token)) {
+            command->maincmd = UNDEFINED;
+            return;
+        }
+        command->bidlist[bidcount++] = strtol(token, NULL, 10);
+    }
+    command->bidcount = bidcount;
+}
+
+double time_parse_cmd(const char *line, size_t length, size_t repeats)
+{
+    char *copy = malloc(length + 1);
+    Command command = { .maincmd = UNDEFINED };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < repeats; i++) {
+        memcpy(copy, line, length + 1);
+        command.bidcount = 0;
+        parse_cmd(&command, copy);
+        sink += command.bidcount;
+    }
+    double ms = elapsed_ms(&start);
+    free_cmd(&command);
+    free(copy);
+    return ms;
+}
+
+double time_strtol(const char *tokens, size_t num_digits)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < NUM_TOKENS; i++) {
+        sink += (unsigned int) strtol(&tokens[i * (num_digits + 1)], NULL, 10);
+    }
+    return elapsed_ms(&start);
+}
+
+double time_parse_uint32(const char *tokens, size_t num_digits)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < NUM_TOKENS; i++) {
+        unsigned int value;
+        parse_uint32(&tokens[i * (num_digits + 1)], num_digits, &value);
+        sink += value;
+    }
+    return elapsed_ms(&start);
+}
+
+double elapsed_ms(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
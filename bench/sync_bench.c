@@ -0,0 +1,145 @@
+/* sync_bench.c: Times synchronize(chain) against the number of unsynced blocks,
+ * next to the union-building strategy it replaced (a linear membership scan
+ * over the union for every candidate block), run on the same input.
+ *
+ * Every size runs on NUM_NODES nodes. Each block id is given to two nodes,
+ * so the union holds half of the blocks added.
+ *
+ * A second table times synchronize(chain) on WIDE_NUM_NODES nodes, each with
+ * its own unsynced blocks, against the number of sync threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/blockchain/blockchain_public.h"
+
+#define NUM_NODES 8
+#define MIN_UNION_SIZE 1000
+#define MAX_UNION_SIZE 64000
+#define NAIVE_MAX_UNION_SIZE 32000
+#define WIDE_NUM_NODES 4096
+#define WIDE_BLOCKS_PER_NODE 64
+#define MAX_SYNC_THREADS 8
+
+static void time_union_sizes();
+static void time_sync_threads();
+static void fill_blockchain(size_t union_size);
+static void fill_wide_blockchain();
+static size_t collect_block_ids(unsigned int *ids);
+static double time_naive_union(const unsigned int *ids, size_t count, size_t union_size);
+static double time_synchronize();
+static double elapsed_ms(const struct timespec *start);
+
+static Blockchain *chain;
+
+int main()
+{
+    time_union_sizes();
+    puts("");
+    time_sync_threads();
+    return EXIT_SUCCESS;
+}
+
+void time_union_sizes()
+{
+    printf("%-16s%-16s%s\n", "union_size", "naive_ms", "synchronize_ms");
+    for (size_t union_size = MIN_UNION_SIZE; union_size <= MAX_UNION_SIZE; union_size *= 2) {
+        chain = new_blockchain();
+        fill_blockchain(union_size);
+        unsigned int *ids = malloc(2 * union_size * sizeof (unsigned int));
+        size_t count = collect_block_ids(ids);
+        printf("%-16zu", union_size);
+        if (union_size <= NAIVE_MAX_UNION_SIZE) {
+            printf("%-16.2f", time_naive_union(ids, count, union_size));
+        } else {
+            printf("%-16s", "-");
+        }
+        printf("%.2f\n", time_synchronize());
+        free(ids);
+        free_blockchain(chain);
+    }
+}
+
+void time_sync_threads()
+{
+    printf("%-16s%s\n", "sync_threads", "synchronize_ms");
+    for (size_t num_threads = 1; num_threads <= MAX_SYNC_THREADS; num_threads *= 2) {
+        chain = new_blockchain();
+        fill_wide_blockchain();
+        set_sync_threads(chain, num_threads);
+        printf("%-16zu%.2f\n", num_threads, time_synchronize());
+        free_blockchain(chain);
+    }
+}
+
+void fill_blockchain(size_t union_size)
+{
+    for (unsigned int nid = 0; nid < NUM_NODES; nid++) {
+        add_node(chain, new_node(chain, nid));
+    }
+    for (unsigned int bid = 0; bid < union_size; bid++) {
+        add_block(bid, get_node_from_id(chain, bid % NUM_NODES));
+        add_block(bid, get_node_from_id(chain, (bid + 1) % NUM_NODES));
+    }
+    update_sync_state(chain);
+}
+
+void fill_wide_blockchain()
+{
+    for (unsigned int nid = 0; nid < WIDE_NUM_NODES; nid++) {
+        Node *node = new_node(chain, nid);
+        add_node(chain, node);
+        for (unsigned int i = 0; i < WIDE_BLOCKS_PER_NODE; i++) {
+            add_block(nid * WIDE_BLOCKS_PER_NODE + i, node);
+        }
+    }
+    update_sync_state(chain);
+}
+
+size_t collect_block_ids(unsigned int *ids)
+{
+    size_t count = 0;
+    for (Node *node = get_nodes(chain); node; node = node->next) {
+        for (Block *block = first_block(node); block; block = next_block(node, block)) {
+            ids[count++] = block->id;
+        }
+    }
+    return count;
+}
+
+double time_naive_union(const unsigned int *ids, size_t count, size_t union_size)
+{
+    unsigned int *sync_union = malloc(union_size * sizeof (unsigned int));
+    size_t length = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        size_t j = 0;
+        while (j < length && sync_union[j] != ids[i]) {
+            j++;
+        }
+        if (j == length) {
+            sync_union[length++] = ids[i];
+        }
+    }
+    double ms = elapsed_ms(&start);
+    free(sync_union);
+    return ms;
+}
+
+double time_synchronize()
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    synchronize(chain);
+    return elapsed_ms(&start);
+}
+
+double elapsed_ms(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
@@ -0,0 +1,529 @@
+/* workload_bench.c: Times every public operation of the blockchain
+ * (blockchain_public.h, node_public.h and save.h) and the commands of
+ * commands.h on a synthetic workload, and prints the latency percentiles
+ * of each, one row per operation, as CSV or JSON:
+ *
+ *     workload_bench [-n nodes] [-b blocks] [-u unsynced%] [-s star%]
+ *                    [-r removal%] [-R runs] [-x seed] [-f csv|json]
+ *
+ * Each run first builds the chain through the API: n nodes of b blocks,
+ * u% of them held by that node alone, so unsynced, the rest by every node.
+ * It times lookups, saves and loads in both formats, sync, then the
+ * removal of r% of the blocks and nodes. It then builds the same chain
+ * again from command lines, s% of the add block commands using *, and
+ * runs a mix of commands of which r% remove blocks or nodes.
+ *
+ * make bench passes BENCH_ARGS to it, for instance:
+ *
+ *     make bench BENCH_ARGS="-n 10000 -b 50 -u 10 -f json"
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/blockchain/blockchain_public.h"
+#include "../src/commands.h"
+#include "../src/error.h"
+#include "../src/parse.h"
+#include "../src/save.h"
+#include "../src/utils/_string.h"
+#include "../src/utils/decimal.h"
+
+#define SAVE_PATHNAME "workload_bench.save"
+#define NUM_LOOKUPS 10000
+#define NUM_SEARCHES 1000
+#define MAX_BIDS_PER_REMOVAL 8
+#define MAX_TOTAL_BLOCKS 100000000
+// Commands run after the build, per node.
+#define MIX_CMDS_PER_NODE 2
+// Digits of an id, plus a space.
+#define MAX_ID_SIZE 11
+
+typedef enum e_op {
+    OP_ADD_NODE, OP_ADD_BLOCK, OP_GET_NODE, OP_HAS_BLOCK, OP_FIND_NODES,
+    OP_UPDATE_SYNC_STATE, OP_SAVE_BINARY, OP_SAVE_TEXT, OP_LOAD_BINARY,
+    OP_LOAD_TEXT, OP_SYNCHRONIZE, OP_RMV_BLOCKS, OP_RMV_NODE,
+    OP_FREE_BLOCKCHAIN, OP_PARSE_CMD, OP_CMD_ADD_NODE, OP_CMD_ADD_BLOCK,
+    OP_CMD_RM_NODE, OP_CMD_RM_BLOCK, OP_CMD_LS, OP_CMD_WHERE_BLOCK,
+    OP_CMD_SYNC, NUM_OPS
+} Op;
+
+static const char *OP_NAMES[NUM_OPS] = {
+    "add_node", "add_block", "get_node_from_id", "has_block_with_id",
+    "find_nodes_with_block", "update_sync_state", "save_binary",
+    "save_text", "load_binary", "load_text", "synchronize",
+    "rmv_blocks_from_all_nodes", "rmv_node", "free_blockchain",
+    "parse_cmd", "cmd_add_node", "cmd_add_block", "cmd_rm_node",
+    "cmd_rm_block", "cmd_ls", "cmd_where_block", "cmd_sync"
+};
+
+typedef struct s_workload {
+    size_t num_nodes;
+    size_t blocks_per_node;
+    size_t unsynced_percent;
+    size_t star_percent;
+    size_t removal_percent;
+    size_t num_runs;
+    unsigned long seed;
+    bool is_json;
+} Workload;
+
+// Latencies of one operation, in nanoseconds.
+typedef struct s_samples {
+    double *values;
+    size_t length;
+    size_t capacity;
+} Samples;
+
+static int parse_workload(int argc, char **argv, Workload *workload);
+static int parse_size(const char *arg, size_t max, size_t *value);
+static void run_api(const Workload *workload);
+static void build_chain(const Workload *workload);
+static void time_lookups(const Workload *workload);
+static void time_saves_and_loads();
+static void time_api_removals(const Workload *workload);
+static void run_commands(const Workload *workload);
+static void run_line(const char *format, ...);
+static void run_cmd(Command *command);
+static unsigned int get_num_bids(const Workload *workload);
+static unsigned int get_num_shared(const Workload *workload);
+static unsigned long next_random();
+static void start(struct timespec *start);
+static void stop(Op op, const struct timespec *start);
+static int compare_doubles(const void *value, const void *other);
+static double get_percentile(const Samples *samples, double percent);
+static void print_results(FILE *file, const Workload *workload);
+
+static Samples samples[NUM_OPS];
+static unsigned long random_state;
+// The line of an add block to every node is the longest.
+static char *line;
+static char *command_line;
+static size_t line_capacity;
+static Blockchain *chain;
+static Command current_command;
+
+int main(int argc, char **argv)
+{
+    Workload workload;
+    if (parse_workload(argc, argv, &workload)) {
+        dprintf(STDERR_FILENO, "usage: workload_bench [-n nodes] [-b blocks] [-u unsynced%%]"
+                " [-s star%%] [-r removal%%]\n"
+                "                      [-R runs] [-x seed] [-f csv|json]\n");
+        return EXIT_FAILURE;
+    }
+    // Results go to the real STDOUT, what ls and where print to /dev/null.
+    FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (!results || null_fd == -1 || dup2(null_fd, STDOUT_FILENO) == -1) {
+        perror("workload_bench");
+        return EXIT_FAILURE;
+    }
+    close(null_fd);
+    silence_errors(true);
+    random_state = workload.seed;
+    line_capacity = (workload.num_nodes + 4) * MAX_ID_SIZE;
+    line = malloc(line_capacity);
+    command_line = malloc(line_capacity);
+    for (size_t run = 0; run < workload.num_runs; run++) {
+        run_api(&workload);
+        run_commands(&workload);
+    }
+    unlink(SAVE_PATHNAME);
+    print_results(results, &workload);
+    fclose(results);
+    free(line);
+    free(command_line);
+    free_cmd(&current_command);
+    for (size_t op = 0; op < NUM_OPS; op++) {
+        free(samples[op].values);
+    }
+    return EXIT_SUCCESS;
+}
+
+int parse_workload(int argc, char **argv, Workload *workload)
+{
+    workload->num_nodes = 1000;
+    workload->blocks_per_node = 100;
+    workload->unsynced_percent = 50;
+    workload->star_percent = 50;
+    workload->removal_percent = 20;
+    workload->num_runs = 3;
+    workload->seed = 1;
+    workload->is_json = false;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) return EXIT_FAILURE;
+        const char *arg = argv[++i];
+        size_t seed;
+        int result = EXIT_SUCCESS;
+        if (!_strcmp(argv[i - 1], "-n")) {
+            result = parse_size(arg, 10000000, &workload->num_nodes);
+        } else if (!_strcmp(argv[i - 1], "-b")) {
+            result = parse_size(arg, 10000000, &workload->blocks_per_node);
+        } else if (!_strcmp(argv[i - 1], "-u")) {
+            result = parse_size(arg, 100, &workload->unsynced_percent);
+        } else if (!_strcmp(argv[i - 1], "-s")) {
+            result = parse_size(arg, 100, &workload->star_percent);
+        } else if (!_strcmp(argv[i - 1], "-r")) {
+            result = parse_size(arg, 100, &workload->removal_percent);
+        } else if (!_strcmp(argv[i - 1], "-R")) {
+            result = parse_size(arg, 1000, &workload->num_runs);
+        } else if (!_strcmp(argv[i - 1], "-x")) {
+            result = parse_size(arg, 4294967295U, &seed);
+            workload->seed = seed + 1;
+        } else if (!_strcmp(argv[i - 1], "-f") && !_strcmp(arg, "json")) {
+            workload->is_json = true;
+        } else if (!_strcmp(argv[i - 1], "-f") && !_strcmp(arg, "csv")) {
+            workload->is_json = false;
+        } else {
+            return EXIT_FAILURE;
+        }
+        if (result) return EXIT_FAILURE;
+    }
+    if (!workload->num_nodes || !workload->blocks_per_node || !workload->num_runs
+        || workload->num_nodes * workload->blocks_per_node > MAX_TOTAL_BLOCKS) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int parse_size(const char *arg, size_t max, size_t *value)
+{
+    unsigned int parsed;
+    if (parse_uint32(arg, _strlen(arg), &parsed) || parsed > max) return EXIT_FAILURE;
+    *value = parsed;
+    return EXIT_SUCCESS;
+}
+
+/* run_api: Times the functions of blockchain_public.h, node_public.h and
+ * save.h.
+ */
+void run_api(const Workload *workload)
+{
+    chain = new_blockchain();
+    build_chain(workload);
+    time_lookups(workload);
+    time_saves_and_loads();
+    struct timespec time;
+    start(&time);
+    synchronize(chain);
+    stop(OP_SYNCHRONIZE, &time);
+    time_api_removals(workload);
+    start(&time);
+    free_blockchain(chain);
+    stop(OP_FREE_BLOCKCHAIN, &time);
+}
+
+/* build_chain: Adds the blocks every node holds, bid by bid, then those of
+ * each node, which take the bids after them.
+ */
+void build_chain(const Workload *workload)
+{
+    struct timespec time;
+    for (unsigned int nid = 0; nid < workload->num_nodes; nid++) {
+        start(&time);
+        add_node(chain, new_node(chain, nid));
+        stop(OP_ADD_NODE, &time);
+    }
+    unsigned int num_shared = get_num_shared(workload);
+    for (unsigned int bid = 0; bid < num_shared; bid++) {
+        for (Node *node = get_nodes(chain); node; node = node->next) {
+            start(&time);
+            add_block(bid, node);
+            stop(OP_ADD_BLOCK, &time);
+        }
+    }
+    unsigned int bid = num_shared;
+    for (Node *node = get_nodes(chain); node; node = node->next) {
+        for (size_t i = num_shared; i < workload->blocks_per_node; i++) {
+            start(&time);
+            add_block(bid++, node);
+            stop(OP_ADD_BLOCK, &time);
+        }
+    }
+    start(&time);
+    update_sync_state(chain);
+    stop(OP_UPDATE_SYNC_STATE, &time);
+}
+
+void time_lookups(const Workload *workload)
+{
+    struct timespec time;
+    unsigned int num_bids = get_num_bids(workload);
+    for (size_t i = 0; i < NUM_LOOKUPS; i++) {
+        unsigned int nid = next_random() % workload->num_nodes;
+        start(&time);
+        Node *node = get_node_from_id(chain, nid);
+        stop(OP_GET_NODE, &time);
+        unsigned int bid = next_random() % num_bids;
+        start(&time);
+        has_block_with_id(bid, node);
+        stop(OP_HAS_BLOCK, &time);
+    }
+    for (size_t i = 0; i < NUM_SEARCHES; i++) {
+        NodeList nodes = create_node_list();
+        unsigned int bid = next_random() % num_bids;
+        start(&time);
+        find_nodes_with_block(chain, bid, &nodes);
+        stop(OP_FIND_NODES, &time);
+        free_node_list(&nodes);
+    }
+}
+
+/* time_saves_and_loads: Leaves the chain as it was loaded from the binary
+ * save.
+ */
+void time_saves_and_loads()
+{
+    struct timespec time;
+    char pathname[] = SAVE_PATHNAME;
+    SnapshotInfo info = { .lineage = 1, .sequence = 0, .is_delta = false };
+    SaveReport report;
+    const SaveFormat formats[] = { SAVE_TEXT, SAVE_BINARY };
+    const Op save_ops[] = { OP_SAVE_TEXT, OP_SAVE_BINARY };
+    const Op load_ops[] = { OP_LOAD_TEXT, OP_LOAD_BINARY };
+    for (size_t i = 0; i < 2; i++) {
+        start(&time);
+        save(pathname, chain, formats[i], &info, &report);
+        stop(save_ops[i], &time);
+        free_blockchain(chain);
+        chain = new_blockchain();
+        start(&time);
+        load(pathname, chain, &info);
+        stop(load_ops[i], &time);
+    }
+}
+
+void time_api_removals(const Workload *workload)
+{
+    struct timespec time;
+    unsigned int num_bids = get_num_bids(workload);
+    unsigned int bids[MAX_BIDS_PER_REMOVAL];
+    // As many removals of blocks as of nodes: once synced, every node holds
+    // every block, and each removal copies the blocks they share.
+    size_t num_removals = workload->num_nodes * workload->removal_percent / 100;
+    for (size_t i = 0; i < num_removals; i++) {
+        size_t num_removed;
+        size_t count = 1 + next_random() % MAX_BIDS_PER_REMOVAL;
+        for (size_t j = 0; j < count; j++) {
+            bids[j] = next_random() % num_bids;
+        }
+        start(&time);
+        rmv_blocks_from_all_nodes(chain, bids, count, &num_removed);
+        stop(OP_RMV_BLOCKS, &time);
+    }
+    for (size_t i = 0; i < num_removals; i++) {
+        Node *node = get_node_from_id(chain, next_random() % workload->num_nodes);
+        if (!node) continue;
+        start(&time);
+        rmv_node(chain, node);
+        stop(OP_RMV_NODE, &time);
+    }
+}
+
+/* run_commands: Times parse_cmd() and the cmd_[X] functions of commands.h,
+ * on the chain build_chain() makes, then on a mix of commands.
+ */
+void run_commands(const Workload *workload)
+{
+    chain = new_blockchain();
+    for (unsigned int nid = 0; nid < workload->num_nodes; nid++) {
+        run_line("add node %u", nid);
+    }
+    unsigned int num_shared = get_num_shared(workload);
+    for (unsigned int bid = 0; bid < num_shared; bid++) {
+        if (next_random() % 100 < workload->star_percent) {
+            run_line("add block %u *", bid);
+            continue;
+        }
+        size_t length = sprintf(line, "add block %u", bid);
+        for (unsigned int nid = 0; nid < workload->num_nodes; nid++) {
+            length += sprintf(&line[length], " %u", nid);
+        }
+        run_line("%s", line);
+    }
+    unsigned int bid = num_shared;
+    for (unsigned int nid = 0; nid < workload->num_nodes; nid++) {
+        for (size_t i = num_shared; i < workload->blocks_per_node; i++) {
+            run_line("add block %u %u", bid++, nid);
+        }
+    }
+    unsigned int num_bids = get_num_bids(workload);
+    for (size_t i = 0; i < workload->num_nodes * MIX_CMDS_PER_NODE; i++) {
+        unsigned long choice = next_random() % 100;
+        if (choice < workload->removal_percent) {
+            // One removal in four is of a node.
+            if (choice % 4)
+                run_line("rm block %u", (unsigned int) (next_random() % num_bids));
+            else
+                run_line("rm node %u", (unsigned int) (next_random() % workload->num_nodes));
+        } else if (choice % 8) {
+            run_line("where block %u", (unsigned int) (next_random() % num_bids));
+        } else {
+            run_line("add block %u %u", num_bids + (unsigned int) i,
+                     (unsigned int) (next_random() % workload->num_nodes));
+        }
+    }
+    run_line("ls -l");
+    run_line("sync");
+    run_line("rm node *");
+    free_blockchain(chain);
+}
+
+/* run_line: Formats a command line, then times its parsing and running. */
+void run_line(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(command_line, line_capacity, format, args);
+    va_end(args);
+    reset_cmd(&current_command);
+    struct timespec time;
+    start(&time);
+    parse_cmd(&current_command, command_line);
+    stop(OP_PARSE_CMD, &time);
+    run_cmd(&current_command);
+}
+
+void run_cmd(Command *command)
+{
+    struct timespec time;
+    start(&time);
+    switch (command->maincmd) {
+    case ADD_NODE:
+        cmd_add_node(chain, command);
+        stop(OP_CMD_ADD_NODE, &time);
+        break;
+    case ADD_BLOCK:
+        cmd_add_block(chain, command);
+        stop(OP_CMD_ADD_BLOCK, &time);
+        break;
+    case RM_NODE:
+        cmd_rm_node(chain, command);
+        stop(OP_CMD_RM_NODE, &time);
+        break;
+    case RM_BLOCK:
+        cmd_rm_block(chain, command);
+        stop(OP_CMD_RM_BLOCK, &time);
+        break;
+    case LS:
+        cmd_ls(chain, command);
+        stop(OP_CMD_LS, &time);
+        break;
+    case WHERE_BLOCK:
+        cmd_where_block(chain, command);
+        stop(OP_CMD_WHERE_BLOCK, &time);
+        break;
+    case SYNC:
+        cmd_sync(chain);
+        stop(OP_CMD_SYNC, &time);
+        break;
+    default:
+        break;
+    }
+}
+
+unsigned int get_num_shared(const Workload *workload)
+{
+    return workload->blocks_per_node * (100 - workload->unsynced_percent) / 100;
+}
+
+unsigned int get_num_bids(const Workload *workload)
+{
+    size_t num_shared = get_num_shared(workload);
+    return num_shared + workload->num_nodes * (workload->blocks_per_node - num_shared);
+}
+
+// xorshift64, so that a seed gives the same workload everywhere.
+unsigned long next_random()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+void start(struct timespec *start)
+{
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void stop(Op op, const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    Samples *op_samples = &samples[op];
+    if (op_samples->length == op_samples->capacity) {
+        op_samples->capacity = op_samples->capacity ? 2 * op_samples->capacity : 1024;
+        op_samples->values = realloc(op_samples->values, op_samples->capacity * sizeof (double));
+    }
+    op_samples->values[op_samples->length++] = (end.tv_sec - start->tv_sec) * 1e9
+                                               + (end.tv_nsec - start->tv_nsec);
+}
+
+int compare_doubles(const void *value, const void *other)
+{
+    double difference = *(const double *) value - *(const double *) other;
+    return (difference > 0) - (difference < 0);
+}
+
+// Nearest rank, on sorted samples.
+double get_percentile(const Samples *samples, double percent)
+{
+    size_t rank = (size_t) (percent / 100 * samples->length + 0.5);
+    return samples->values[rank ? rank - 1 : 0];
+}
+
+void print_results(FILE *file, const Workload *workload)
+{
+    if (workload->is_json) {
+        fprintf(file, "{\"workload\": {\"nodes\": %zu, \"blocks_per_node\": %zu, "
+                "\"unsynced_percent\": %zu, \"star_percent\": %zu, \"removal_percent\": %zu, "
+                "\"runs\": %zu, \"seed\": %lu},\n \"operations\": [",
+                workload->num_nodes, workload->blocks_per_node, workload->unsynced_percent,
+                workload->star_percent, workload->removal_percent, workload->num_runs,
+                workload->seed - 1);
+    } else {
+        fprintf(file, "operation,count,mean_us,p50_us,p90_us,p99_us,p999_us,max_us,total_ms\n");
+    }
+    bool is_first = true;
+    for (size_t op = 0; op < NUM_OPS; op++) {
+        Samples *op_samples = &samples[op];
+        if (!op_samples->length) continue;
+        qsort(op_samples->values, op_samples->length, sizeof (double), compare_doubles);
+        double total = 0;
+        for (size_t i = 0; i < op_samples->length; i++) {
+            total += op_samples->values[i];
+        }
+        double percentiles[] = {
+            get_percentile(op_samples, 50) / 1e3, get_percentile(op_samples, 90) / 1e3,
+            get_percentile(op_samples, 99) / 1e3, get_percentile(op_samples, 99.9) / 1e3,
+            op_samples->values[op_samples->length - 1] / 1e3
+        };
+        double mean = total / op_samples->length / 1e3;
+        if (workload->is_json) {
+            fprintf(file, "%s\n  {\"operation\": \"%s\", \"count\": %zu, \"mean_us\": %.3f, "
+                    "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, "
+                    "\"max_us\": %.3f, \"total_ms\": %.3f}",
+                    is_first ? "" : ",", OP_NAMES[op], op_samples->length, mean,
+                    percentiles[0], percentiles[1], percentiles[2], percentiles[3],
+                    percentiles[4], total / 1e6);
+        } else {
+            fprintf(file, "%s,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", OP_NAMES[op],
+                    op_samples->length, mean, percentiles[0], percentiles[1], percentiles[2],
+                    percentiles[3], percentiles[4], total / 1e6);
+        }
+        is_first = false;
+    }
+    if (workload->is_json) {
+        fprintf(file, "\n]}\n");
+    }
+}
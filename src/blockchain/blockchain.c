@@ -1,272 +1,633 @@
+// For pthread_rwlockattr_setkind_np().
+#define _GNU_SOURCE
+
 #include "blockchain_private.h"
 #include "node/node_private.h"
 #include "node/block/block_private.h"
+#include "../utils/uint_map.h"
+#include "../utils/uint_index.h"
+#include "../utils/thread_pool.h"
+#include "../utils/mem.h"
+#include <pthread.h>
 #include <stdlib.h>
 
-typedef struct s_blockchain {
+/* The nodes, in insertion order, with everything derived from them. Nodes
+ * come from a pool of the blockchain's own, so that each blockchain is
+ * freed at once, apart from the others.
+ * lock is taken by callers, see blockchain_public.h.
+ */
+struct s_blockchain {
     Node *head;
     Node *tail;
     size_t num_nodes;
-} Blockchain;
+    UintMap node_index;
+    NodeTracker node_tracker;
+    UintIndex next_block_tally;
+    size_t num_tallied;
+    ThreadPool sync_pool;
+    UintIndex unsaved_removals;
+    bool lost_removals;
+    Pool node_pool;
+    pthread_rwlock_t lock;
+};
+
+static int init_lock(pthread_rwlock_t *lock);
+
+/* new_blockchain: Returns an empty blockchain, to be freed with
+ * free_blockchain(), or NULL if it cannot be allocated. Blockchains share
+ * nothing, so that different threads may each work on their own.
+ */
+Blockchain *new_blockchain()
+{
+    Blockchain *chain = calloc(1, sizeof (Blockchain));
+    if (!chain) return NULL;
+    if (init_lock(&chain->lock)) {
+        free(chain);
+        return NULL;
+    }
+    chain->node_pool.object_size = sizeof (Node);
+    chain->node_pool.kind = MEM_NODES;
+    return chain;
+}
+
+/* init_lock: With glibc, readers queue behind a waiting writer, so that a
+ * steady stream of listings cannot keep the writer out.
+ */
+int init_lock(pthread_rwlock_t *lock)
+{
+    pthread_rwlockattr_t attr;
+    if (pthread_rwlockattr_init(&attr)) return EXIT_FAILURE;
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int status = pthread_rwlock_init(lock, &attr) ? EXIT_FAILURE : EXIT_SUCCESS;
+    pthread_rwlockattr_destroy(&attr);
+    return status;
+}
 
-static Blockchain blockchain;
+void lock_blockchain_for_reading(Blockchain *chain)
+{
+    pthread_rwlock_rdlock(&chain->lock);
+}
 
-Node *get_nodes()
+void lock_blockchain_for_writing(Blockchain *chain)
 {
-    return blockchain.head;
+    pthread_rwlock_wrlock(&chain->lock);
 }
 
-bool has_node_with_id(unsigned int nid)
+void unlock_blockchain(Blockchain *chain)
 {
-    return get_node_from_id(nid) != NULL;
+    pthread_rwlock_unlock(&chain->lock);
 }
 
-Node *get_node_from_id(unsigned int nid)
+Node *new_node(Blockchain *chain, unsigned int nid)
 {
-    Node *node = blockchain.head;
-    while (node && node->id != nid) {
-        node = node->next;
+    Node *node = pool_alloc(&chain->node_pool);
+    if (node) {
+        init_node(node, nid);
     }
     return node;
 }
 
-static bool is_empty();
-static void add_first_node(Node *node);
-static void desync();
+/* free_node: Only for nodes that were never added; rmv_node() frees the
+ * others.
+ */
+void free_node(Blockchain *chain, Node *node)
+{
+    free_node_blocks(node);
+    pool_free(&chain->node_pool, node);
+}
 
-void add_node(Node *node)
+PoolStats get_node_stats(const Blockchain *chain)
 {
-    if (is_empty()) {
-        add_first_node(node);
-        return;
+    return get_pool_stats(&chain->node_pool);
+}
+
+Node *get_nodes(const Blockchain *chain)
+{
+    return chain->head;
+}
+
+bool has_node_with_id(const Blockchain *chain, unsigned int nid)
+{
+    return get_node_from_id(chain, nid) != NULL;
+}
+
+Node *get_node_from_id(const Blockchain *chain, unsigned int nid)
+{
+    return uint_map_get(&chain->node_index, nid);
+}
+
+static bool is_empty(const Blockchain *chain);
+static void add_first_node(Blockchain *chain, Node *node);
+static void desync(Blockchain *chain);
+
+int add_node(Blockchain *chain, Node *node)
+{
+    if (uint_map_put(&chain->node_index, node->id, node)) {
+        return EXIT_FAILURE;
+    }
+    attach_tracker(node, &chain->node_tracker);
+    if (is_empty(chain)) {
+        add_first_node(chain, node);
+        return EXIT_SUCCESS;
     }
-    desync();
-    node->prev = blockchain.tail;
-    blockchain.tail = blockchain.tail->next = node;
-    blockchain.num_nodes++;
+    desync(chain);
+    node->prev = chain->tail;
+    chain->tail = chain->tail->next = node;
+    chain->num_nodes++;
+    return EXIT_SUCCESS;
 }
 
-bool is_empty()
+bool is_empty(const Blockchain *chain)
 {
-    return blockchain.num_nodes == 0;
+    return chain->num_nodes == 0;
 }
 
-void add_first_node(Node *node)
+void add_first_node(Blockchain *chain, Node *node)
 {
-    blockchain.head = blockchain.tail = node;
-    blockchain.num_nodes = 1;
+    chain->head = chain->tail = node;
+    chain->num_nodes = 1;
 }
 
-void desync()
+void desync(Blockchain *chain)
 {
-    Node *node = blockchain.head;
+    if (!chain->node_tracker.num_with_synced_blocks) return;
+    Node *node = chain->head;
     while (node) {
-        node->sync_tail = NULL;
+        set_sync_length(node, 0);
         node = node->next;
     }
 }
 
-static void attach_dummy_head_and_tail();
-static void detach_dummy_head_and_tail();
+static void untally_next_block(Blockchain *chain, Node *node);
 
-void rmv_node(Node *node)
+void rmv_node(Blockchain *chain, Node *node)
 {
-    if (is_empty() || blockchain.num_nodes == 1) {
-        free_node(node);
-        blockchain.head = blockchain.tail = NULL;
-        blockchain.num_nodes = 0;
-        return;
+    uint_map_remove(&chain->node_index, node->id);
+    if (uint_index_put(&chain->unsaved_removals, node->id, 0)) {
+        chain->lost_removals = true;
+    }
+    untally_next_block(chain, node);
+    detach_tracker(node);
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        chain->head = node->next;
     }
-    attach_dummy_head_and_tail();
-    node->prev->next = node->next;
-    node->next->prev = node->prev;
-    detach_dummy_head_and_tail();
-    free_node(node);
-    blockchain.num_nodes--;
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        chain->tail = node->prev;
+    }
+    free_node(chain, node);
+    chain->num_nodes--;
 }
 
-static Node dummy_head;
-static Node dummy_tail;
+static bool has_block_holders(Blockchain *chain);
+static int rmv_blocks_from_nodes(BlockRemoval *removal, const NodeList *nodes,
+                                 size_t *num_removed);
 
-void attach_dummy_head_and_tail()
+/* rmv_blocks_from_all_nodes: Removes the blocks with any of the num_bids
+ * ids in bids from every node, visiting only the nodes that hold one, each
+ * once, and sets num_removed to the number of blocks removed.
+ */
+int rmv_blocks_from_all_nodes(Blockchain *chain, const unsigned int *bids, size_t num_bids,
+                              size_t *num_removed)
 {
-    blockchain.head->prev = &dummy_head;
-    dummy_head.next = blockchain.head;
-
-    blockchain.tail->next = &dummy_tail;
-    dummy_tail.prev = blockchain.tail;
+    *num_removed = 0;
+    BlockRemoval removal;
+    if (create_block_removal(&removal, bids, num_bids)) return EXIT_FAILURE;
+    int status = EXIT_SUCCESS;
+    NodeList nodes = create_node_list();
+    if (has_block_holders(chain) && !collect_nodes_holding(&chain->node_tracker, removal.ids,
+                                                      removal.num_ids, &nodes)) {
+        status = rmv_blocks_from_nodes(&removal, &nodes, num_removed);
+    } else {
+        for (Node *node = chain->head; node && !status; node = node->next) {
+            status = rmv_blocks(&removal, node, num_removed);
+        }
+    }
+    free_node_list(&nodes);
+    free_block_removal(&removal);
+    return status;
 }
 
-void detach_dummy_head_and_tail()
+int rmv_blocks_from_nodes(BlockRemoval *removal, const NodeList *nodes, size_t *num_removed)
 {
-    blockchain.head = dummy_head.next;
-    blockchain.head->prev = NULL;
+    for (size_t i = 0; i < nodes->length; i++) {
+        if (rmv_blocks(removal, nodes->nodes[i], num_removed)) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
-    blockchain.tail = dummy_tail.prev;
-    blockchain.tail->next = NULL;
+/* find_nodes_with_block: Adds every node holding block bid to nodes, in
+ * no particular order.
+ */
+int find_nodes_with_block(Blockchain *chain, unsigned int bid, NodeList *nodes)
+{
+    if (has_block_holders(chain)
+            && !collect_nodes_holding(&chain->node_tracker, &bid, 1, nodes)) {
+        return EXIT_SUCCESS;
+    }
+    free_node_list(nodes);
+    for (Node *node = chain->head; node; node = node->next) {
+        if (has_block_with_id(bid, node) && add_to_node_list(nodes, node)) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
-size_t get_num_nodes()
+/* has_block_holders: The block holders are built on first use, and rebuilt
+ * after running out of memory. If they cannot be, callers scan the nodes.
+ */
+bool has_block_holders(Blockchain *chain)
 {
-    return blockchain.num_nodes;
+    NodeTracker *tracker = &chain->node_tracker;
+    return tracker->holders.is_complete || !hold_all_blocks(tracker, chain->head);
 }
 
-static bool all_nodes_are_empty();
+size_t get_num_nodes(const Blockchain *chain)
+{
+    return chain->num_nodes;
+}
 
-bool blockchain_is_synced()
+/* blockchain_is_synced: Either all nodes are empty, or none is and every
+ * node is synced.
+ */
+bool blockchain_is_synced(const Blockchain *chain)
 {
-    if (all_nodes_are_empty()) {
+    const NodeTracker *tracker = &chain->node_tracker;
+    if (tracker->num_empty == chain->num_nodes) {
         return true;
     }
-    Node *node = blockchain.head;
+    return !tracker->num_empty && !tracker->num_unsynced;
+}
+
+static int fill_sync_union(const Blockchain *chain, BlockArray *sync_union);
+static int put_node_content_in_sync_union(Node *node, BlockArray *sync_union);
+static int sync_nodes(const Blockchain *chain, const BlockArray *sync_union);
+static int sync_node(Node *node, const Node *reference, SharedBlocks *synced,
+                     const BlockArray *sync_union);
+static int synchronize_in_parallel(Blockchain *chain);
+
+/* set_sync_threads: synchronize() splits its work across num_threads
+ * threads, the calling one included. With one thread, the default, it runs
+ * serially and starts no threads.
+ */
+int set_sync_threads(Blockchain *chain, size_t num_threads)
+{
+    free_thread_pool(&chain->sync_pool);
+    return create_thread_pool(&chain->sync_pool, num_threads);
+}
+
+int synchronize(Blockchain *chain)
+{
+    if (chain->sync_pool.num_workers > 1 && chain->num_nodes > 1) {
+        return synchronize_in_parallel(chain);
+    }
+    BlockArray sync_union = create_block_array_of(MEM_SCRATCH);
+    int status = fill_sync_union(chain, &sync_union) || sync_nodes(chain, &sync_union);
+    free_block_array(&sync_union);
+    return status;
+}
+
+int fill_sync_union(const Blockchain *chain, BlockArray *sync_union)
+{
+    Node *node = chain->head;
     while (node) {
-        if (node_is_empty(node) || !node_is_synced(node)) {
-            return false;
+        if (put_node_content_in_sync_union(node, sync_union)) {
+            return EXIT_FAILURE;
         }
         node = node->next;
     }
-    return true;
+    return EXIT_SUCCESS;
 }
 
-bool all_nodes_are_empty()
+int put_node_content_in_sync_union(Node *node, BlockArray *sync_union)
 {
-    Node *node = blockchain.head;
-    while (node) {
-        if (!node_is_empty(node)) {
-            return false;
+    Block *block = get_first_post_sync_block(node);
+    for (; block; block = next_block(node, block)) {
+        if (!get_block(sync_union, block->id) && append_block(sync_union, block->id)) {
+            return EXIT_FAILURE;
         }
+    }
+    return rmv_post_sync_blocks(node);
+}
+
+/* sync_nodes: Once their unsynced blocks are removed, nodes usually hold
+ * the same blocks, often as a sequence they already share. Those nodes all
+ * get to share one new sequence, with the union appended, instead of each
+ * getting a copy of the union. The first node is the reference, so it is
+ * synced last.
+ */
+int sync_nodes(const Blockchain *chain, const BlockArray *sync_union)
+{
+    if (!sync_union->length) return EXIT_SUCCESS;
+    Node *reference = chain->head;
+    SharedBlocks *synced = new_synced_blocks(reference, sync_union->slots, sync_union->length);
+    if (!synced) return EXIT_FAILURE;
+    int status = EXIT_SUCCESS;
+    Node *node = reference->next;
+    while (node && !status) {
+        status = sync_node(node, reference, synced, sync_union);
         node = node->next;
     }
-    return true;
+    if (!status) {
+        set_shared_blocks(reference, synced);
+        declare_node_synced(reference);
+    }
+    release_shared_blocks(synced);
+    return status;
 }
 
-static int fill_dummy_sync_node();
-static int put_node_content_in_dummy_sync_node(Node *node, Node *dummy_sync_node);
-static int put_block_in_dummy_sync_node(Block *block, Node *dummy_sync_node);
-static int sync_nodes(const Node *dummy_sync_node);
+int sync_node(Node *node, const Node *reference, SharedBlocks *synced,
+              const BlockArray *sync_union)
+{
+    if (node_has_same_blocks(node, reference)) {
+        set_shared_blocks(node, synced);
+    } else if (add_blocks(sync_union->slots, sync_union->length, node)) {
+        return EXIT_FAILURE;
+    }
+    declare_node_synced(node);
+    return EXIT_SUCCESS;
+}
 
-int synchronize()
+/* A run of consecutive nodes, handled by one worker of a parallel sync.
+ */
+typedef struct s_sync_chunk {
+    Node *first;
+    size_t num_nodes;
+    BlockArray sync_union;
+    int status;
+} SyncChunk;
+
+typedef struct s_parallel_sync {
+    SyncChunk *chunks;
+    size_t num_chunks;
+    const Node *reference;
+    SharedBlocks *synced;
+    const BlockArray *sync_union;
+} ParallelSync;
+
+static SyncChunk *split_into_chunks(const Blockchain *chain, size_t num_chunks);
+static void fill_chunk_sync_union(void *arg, size_t worker);
+static int merge_chunk_sync_unions(const ParallelSync *sync, BlockArray *sync_union);
+static int sync_nodes_in_parallel(Blockchain *chain, ParallelSync *sync);
+static void sync_chunk_nodes(void *arg, size_t worker);
+static int get_chunks_status(const ParallelSync *sync);
+static void set_nodes_tracked(Blockchain *chain, bool tracked);
+
+/* synchronize_in_parallel: Same result as the serial sync. Each worker
+ * builds the union of its own chunk, and the chunk unions are merged in
+ * chunk order, which keeps every block where the serial sync would put
+ * it. Workers then sync their chunks against the merged union.
+ *
+ * Nodes are detached from the tracker meanwhile, as it is shared by all of
+ * them; reattaching them marks them all as changed. The block holders are
+ * dropped first, to be rebuilt when next needed, rather than maintained one
+ * node at a time.
+ */
+int synchronize_in_parallel(Blockchain *chain)
 {
-    Node dummy_sync_node = create_node(0);
-    int status = fill_dummy_sync_node(&dummy_sync_node) || sync_nodes(&dummy_sync_node);
-    free_chain(dummy_sync_node.head);
+    size_t num_chunks = chain->sync_pool.num_workers;
+    if (num_chunks > chain->num_nodes) {
+        num_chunks = chain->num_nodes;
+    }
+    ParallelSync sync = {
+            .chunks = split_into_chunks(chain, num_chunks),
+            .num_chunks = num_chunks
+    };
+    if (!sync.chunks) return EXIT_FAILURE;
+    reset_block_holders(&chain->node_tracker.holders, false);
+    set_nodes_tracked(chain, false);
+    run_on_thread_pool(&chain->sync_pool, fill_chunk_sync_union, &sync);
+    BlockArray sync_union = create_block_array_of(MEM_SCRATCH);
+    int status = get_chunks_status(&sync) || merge_chunk_sync_unions(&sync, &sync_union);
+    if (!status) {
+        sync.sync_union = &sync_union;
+        status = sync_nodes_in_parallel(chain, &sync);
+    }
+    set_nodes_tracked(chain, true);
+    free_block_array(&sync_union);
+    for (size_t i = 0; i < num_chunks; i++) {
+        free_block_array(&sync.chunks[i].sync_union);
+    }
+    mem_free(MEM_SCRATCH, sync.chunks, num_chunks * sizeof (SyncChunk));
     return status;
 }
 
-int fill_dummy_sync_node(Node *dummy_sync_node)
+SyncChunk *split_into_chunks(const Blockchain *chain, size_t num_chunks)
 {
-    Node *node = blockchain.head;
-    while (node) {
-        if (put_node_content_in_dummy_sync_node(node, dummy_sync_node)) {
-            return EXIT_FAILURE;
+    SyncChunk *chunks = mem_alloc(MEM_SCRATCH, num_chunks * sizeof (SyncChunk));
+    if (!chunks) return NULL;
+    Node *node = chain->head;
+    for (size_t i = 0; i < num_chunks; i++) {
+        chunks[i].first = node;
+        chunks[i].num_nodes = chain->num_nodes / num_chunks
+                              + (i < chain->num_nodes % num_chunks);
+        chunks[i].sync_union = create_block_array_of(MEM_SCRATCH);
+        chunks[i].status = EXIT_SUCCESS;
+        for (size_t j = 0; j < chunks[i].num_nodes; j++) {
+            node = node->next;
         }
+    }
+    return chunks;
+}
+
+void fill_chunk_sync_union(void *arg, size_t worker)
+{
+    ParallelSync *sync = arg;
+    if (worker >= sync->num_chunks) return;
+    SyncChunk *chunk = &sync->chunks[worker];
+    Node *node = chunk->first;
+    for (size_t i = 0; i < chunk->num_nodes && !chunk->status; i++) {
+        chunk->status = put_node_content_in_sync_union(node, &chunk->sync_union);
         node = node->next;
     }
-    return EXIT_SUCCESS;
 }
 
-int put_node_content_in_dummy_sync_node(Node *node, Node *dummy_sync_node)
+int merge_chunk_sync_unions(const ParallelSync *sync, BlockArray *sync_union)
 {
-    Block *post_sync_block = get_post_sync_chain(node);
-    while (post_sync_block) {
-        Block *current = post_sync_block;
-        post_sync_block = current->next;
-        if (put_block_in_dummy_sync_node(current, dummy_sync_node)) {
-            return EXIT_FAILURE;
+    for (size_t i = 0; i < sync->num_chunks; i++) {
+        const BlockArray *chunk_union = &sync->chunks[i].sync_union;
+        for (size_t j = 0; j < chunk_union->length; j++) {
+            unsigned int bid = chunk_union->slots[j].id;
+            if (!get_block(sync_union, bid) && append_block(sync_union, bid)) {
+                return EXIT_FAILURE;
+            }
         }
-        rmv_block(current, node);
     }
     return EXIT_SUCCESS;
 }
 
-int put_block_in_dummy_sync_node(Block *block, Node *dummy_sync_node)
+/* sync_nodes_in_parallel: As sync_nodes(), the reference node is synced
+ * last, once the workers are done comparing against it.
+ */
+int sync_nodes_in_parallel(Blockchain *chain, ParallelSync *sync)
 {
-    if (!has_block_with_id(block->id, dummy_sync_node)) {
-        Block *clone = new_block(block->id);
-        if (!clone) return EXIT_FAILURE;
-        add_block(clone, dummy_sync_node);
+    if (!sync->sync_union->length) return EXIT_SUCCESS;
+    Node *reference = chain->head;
+    sync->reference = reference;
+    sync->synced = new_synced_blocks(reference, sync->sync_union->slots,
+                                     sync->sync_union->length);
+    if (!sync->synced) return EXIT_FAILURE;
+    run_on_thread_pool(&chain->sync_pool, sync_chunk_nodes, sync);
+    int status = get_chunks_status(sync);
+    if (!status) {
+        set_shared_blocks(reference, sync->synced);
+        declare_node_synced(reference);
     }
-    return EXIT_SUCCESS;
+    release_shared_blocks(sync->synced);
+    return status;
 }
 
-int sync_nodes(const Node *dummy_sync_node)
+void sync_chunk_nodes(void *arg, size_t worker)
 {
-    if (node_is_empty(dummy_sync_node)) return EXIT_SUCCESS;
-    Node *node = blockchain.head;
-    while (node) {
-        Block* clone = clone_chain(dummy_sync_node->head);
-        if (!clone) return EXIT_FAILURE;
-        add_chain(clone, node);
-        declare_node_synced(node);
+    ParallelSync *sync = arg;
+    if (worker >= sync->num_chunks) return;
+    SyncChunk *chunk = &sync->chunks[worker];
+    Node *node = chunk->first;
+    for (size_t i = 0; i < chunk->num_nodes && !chunk->status; i++) {
+        if (node != sync->reference) {
+            chunk->status = sync_node(node, sync->reference, sync->synced, sync->sync_union);
+        }
         node = node->next;
     }
+}
+
+int get_chunks_status(const ParallelSync *sync)
+{
+    for (size_t i = 0; i < sync->num_chunks; i++) {
+        if (sync->chunks[i].status) return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
 
-static void update_sync_state_setup(Block *dummy_heads[], Block *sync_tails[]);
-static void update_sync_state_teardown(Block *dummy_heads[], Block *sync_tails[]);
-static bool sync_tails_can_advance(Block *sync_tails[]);
-static void advance_sync_tails(Block *sync_tails[]);
+void set_nodes_tracked(Blockchain *chain, bool tracked)
+{
+    for (Node *node = chain->head; node; node = node->next) {
+        if (tracked) {
+            attach_tracker(node, &chain->node_tracker);
+        } else {
+            detach_tracker(node);
+        }
+    }
+}
 
-void update_sync_state()
+static void tally_dirty_nodes(Blockchain *chain);
+static void tally_next_block(Blockchain *chain, Node *node);
+static bool sync_boundaries_can_advance(const Blockchain *chain);
+static void advance_sync_boundaries(Blockchain *chain);
+
+/* update_sync_state: Moves every node's sync boundary forward for as long
+ * as all nodes have the same block right after it.
+ *
+ * Rather than comparing those blocks across all nodes on every call, the
+ * blockchain keeps a tally of how many nodes have each block id right after
+ * their boundary, and only re-tallies the nodes that changed since the last
+ * call. All nodes agree when every node is in the tally and the tally has
+ * a single entry.
+ */
+void update_sync_state(Blockchain *chain)
 {
-    if (blockchain.num_nodes == 0) return;
-    Block *dummy_heads[blockchain.num_nodes];
-    Block *sync_tails[blockchain.num_nodes];
-    update_sync_state_setup(dummy_heads, sync_tails);
-    while (sync_tails_can_advance(sync_tails)) {
-        advance_sync_tails(sync_tails);
+    tally_dirty_nodes(chain);
+    while (sync_boundaries_can_advance(chain)) {
+        advance_sync_boundaries(chain);
+        tally_dirty_nodes(chain);
     }
-    update_sync_state_teardown(dummy_heads, sync_tails);
 }
 
-void update_sync_state_setup(Block *dummy_heads[], Block *sync_tails[])
+void tally_dirty_nodes(Blockchain *chain)
 {
-    size_t i;
     Node *node;
-    for (i = 0, node = blockchain.head; node; i++, node = node->next) {
-        dummy_heads[i] = new_block(0);
-        sync_tails[i] = dummy_heads[i];
-        sync_tails[i]->next = node->sync_tail ? node->sync_tail->next : node->head;
+    while ((node = pop_dirty_node(&chain->node_tracker))) {
+        untally_next_block(chain, node);
+        tally_next_block(chain, node);
     }
 }
 
-void update_sync_state_teardown(Block *dummy_heads[], Block *sync_tails[])
+/* tally_next_block: The tally only grows when a new distinct id shows up;
+ * it never holds more entries than there are nodes. If it cannot grow, the
+ * node is left out, which keeps every boundary where it is.
+ */
+void tally_next_block(Blockchain *chain, Node *node)
 {
-    size_t i;
-    Node *node;
-    for (i = 0, node = blockchain.head; node; i++, node = node->next) {
-        if (sync_tails[i] != dummy_heads[i]) {
-            node->sync_tail = sync_tails[i];
-        }
-        free_block(dummy_heads[i]);
+    Block *next = get_first_post_sync_block(node);
+    if (!next) return;
+    unsigned int count = uint_index_get(&chain->next_block_tally, next->id);
+    count = count == UINT_INDEX_NONE ? 1 : count + 1;
+    if (uint_index_put(&chain->next_block_tally, next->id, count)) return;
+    chain->num_tallied++;
+    node->next_is_tallied = true;
+    node->tallied_next_id = next->id;
+}
+
+void untally_next_block(Blockchain *chain, Node *node)
+{
+    if (!node->next_is_tallied) return;
+    unsigned int count = uint_index_get(&chain->next_block_tally, node->tallied_next_id);
+    if (count == 1) {
+        uint_index_remove(&chain->next_block_tally, node->tallied_next_id);
+    } else {
+        uint_index_put(&chain->next_block_tally, node->tallied_next_id, count - 1);
     }
+    chain->num_tallied--;
+    node->next_is_tallied = false;
 }
 
-static bool sync_tails_can_advance(Block *sync_tails[])
+bool sync_boundaries_can_advance(const Blockchain *chain)
 {
-    bool id_set = false;
-    unsigned int id;
-    for (size_t i = 0; i < blockchain.num_nodes; i++) {
-        if (!sync_tails[i]->next || (id_set && sync_tails[i]->next->id != id)) {
-            return false;
-        }
-        if (!id_set) {
-            id = sync_tails[i]->next->id;
-            id_set = true;
-        }
+    return chain->num_nodes
+           && chain->num_tallied == chain->num_nodes
+           && chain->next_block_tally.size == 1;
+}
+
+void advance_sync_boundaries(Blockchain *chain)
+{
+    for (Node *node = chain->head; node; node = node->next) {
+        Block *next = get_first_post_sync_block(node);
+        set_sync_length(node, get_block_position(node, next) + 1);
     }
-    return true;
 }
 
-void advance_sync_tails(Block *sync_tails[])
+/* get_unsaved_removals: The ids of the nodes removed since the blockchain
+ * was last saved, as the keys of an index, or NULL if some could not be
+ * recorded.
+ */
+const UintIndex *get_unsaved_removals(const Blockchain *chain)
+{
+    return chain->lost_removals ? NULL : &chain->unsaved_removals;
+}
+
+/* declare_blockchain_saved: From now on, only the nodes changed or removed
+ * after this call are unsaved.
+ */
+void declare_blockchain_saved(Blockchain *chain)
 {
-    for (size_t i = 0; i < blockchain.num_nodes; i++) {
-        sync_tails[i] = sync_tails[i]->next;
+    for (Node *node = chain->head; node; node = node->next) {
+        node->is_unsaved = false;
     }
+    free_uint_index(&chain->unsaved_removals);
+    chain->lost_removals = false;
 }
 
-void free_blockchain()
+/* free_blockchain: Frees chain along with all of its nodes, and stops its
+ * sync threads. No other thread may be using chain, nor wait for its lock.
+ */
+void free_blockchain(Blockchain *chain)
 {
-    free_node_chain(blockchain.head);
+    if (!chain) return;
+    for (Node *node = chain->head; node; node = node->next) {
+        free_node_blocks(node);
+    }
+    pool_release_all(&chain->node_pool);
+    free_uint_map(&chain->node_index);
+    free_uint_index(&chain->next_block_tally);
+    free_block_holders(&chain->node_tracker.holders);
+    free_thread_pool(&chain->sync_pool);
+    free_uint_index(&chain->unsaved_removals);
+    pthread_rwlock_destroy(&chain->lock);
+    free(chain);
 }
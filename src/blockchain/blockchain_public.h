@@ -2,18 +2,47 @@
 #define BLOCKCHAIN_PUBLIC_H
 
 #include "node/node_public.h"
+#include "../utils/pool.h"
+#include "../utils/uint_index.h"
 #include <stdbool.h>
 #include <stddef.h>
 
-Node *get_nodes();
-bool has_node_with_id(unsigned int nid);
-Node *get_node_from_id(unsigned int nid);
-void add_node(Node *node);
-void rmv_node(Node *node);
-size_t get_num_nodes();
-bool blockchain_is_synced();
-int synchronize();
-void update_sync_state();
-void free_blockchain();
+/* A blockchain and all of its state. Every function that reads or changes
+ * one takes it explicitly, so that a process may hold many of them.
+ *
+ * Threads may share a blockchain, many reading while one writes, if each
+ * brackets what it does between a lock_blockchain_for_[X]() and
+ * unlock_blockchain(). Reading is calling get_nodes(), has_node_with_id(),
+ * get_node_from_id(), get_num_nodes(), blockchain_is_synced(),
+ * get_unsaved_removals(), the functions of node_public.h that take a
+ * const Node, and write_snapshot(), and following node->next. Anything
+ * else needs the write lock, find_nodes_with_block() included, as it
+ * builds the block holders on first use. The lock is not recursive.
+ */
+typedef struct s_blockchain Blockchain;
+
+Blockchain *new_blockchain();
+void lock_blockchain_for_reading(Blockchain *chain);
+void lock_blockchain_for_writing(Blockchain *chain);
+void unlock_blockchain(Blockchain *chain);
+Node *new_node(Blockchain *chain, unsigned int nid);
+void free_node(Blockchain *chain, Node *node);
+PoolStats get_node_stats(const Blockchain *chain);
+Node *get_nodes(const Blockchain *chain);
+bool has_node_with_id(const Blockchain *chain, unsigned int nid);
+Node *get_node_from_id(const Blockchain *chain, unsigned int nid);
+int add_node(Blockchain *chain, Node *node);
+void rmv_node(Blockchain *chain, Node *node);
+int rmv_blocks_from_all_nodes(Blockchain *chain, const unsigned int *bids, size_t num_bids,
+                              size_t *num_removed);
+int find_nodes_with_block(Blockchain *chain, unsigned int bid, NodeList *nodes);
+size_t get_num_nodes(const Blockchain *chain);
+bool blockchain_is_synced(const Blockchain *chain);
+int set_sync_threads(Blockchain *chain, size_t num_threads);
+int synchronize(Blockchain *chain);
+void update_sync_state(Blockchain *chain);
+const UintIndex *get_unsaved_removals(const Blockchain *chain);
+void declare_blockchain_saved(Blockchain *chain);
+void free_blockchain(Blockchain *chain);
 
 #endif
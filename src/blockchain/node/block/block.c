@@ -1,66 +1,337 @@
 #include "block_private.h"
+#include "../../../utils/mem.h"
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
-static Block create_block(unsigned int bid);
-static Block *clone_block(const Block *block, Block *prev);
+#define BLOCK_ARRAY_MIN_CAPACITY 8
+// Compact once at least this many tombstones make up half of the slots.
+#define COMPACTION_MIN_TOMBSTONES 32
 
-Block *new_block(unsigned int bid)
+static int reserve(BlockArray *array, size_t capacity);
+static size_t get_size(size_t capacity);
+static size_t bitmap_size(size_t capacity);
+static void reindex(BlockArray *array);
+static void set_tombstone(BlockArray *array, size_t i);
+static void clear_tombstone(BlockArray *array, size_t i);
+static void trim_tombstones(BlockArray *array);
+
+BlockArray create_block_array()
+{
+    return create_block_array_of(MEM_BLOCKS);
+}
+
+BlockArray create_block_array_of(MemKind kind)
+{
+    BlockArray array = {
+            .slots = NULL,
+            .tombstones = NULL,
+            .holder_positions = NULL,
+            .length = 0,
+            .capacity = 0,
+            .num_holder_positions = 0,
+            .num_tombstones = 0,
+            .index = create_uint_index_of(kind)
+    };
+    return array;
+}
+
+Block *get_block(const BlockArray *array, unsigned int bid)
+{
+    unsigned int position = uint_index_get(&array->index, bid);
+    return position == UINT_INDEX_NONE ? NULL : &array->slots[position];
+}
+
+/* get_live_block: Returns the first block at or after slot from that is not
+ * a tombstone, or NULL if there is none.
+ */
+Block *get_live_block(const BlockArray *array, size_t from)
+{
+    if (!array->num_tombstones) {
+        return from < array->length ? &array->slots[from] : NULL;
+    }
+    for (size_t i = from; i < array->length; i++) {
+        if (!is_tombstone(array, i)) return &array->slots[i];
+    }
+    return NULL;
+}
+
+bool is_tombstone(const BlockArray *array, size_t i)
+{
+    return array->tombstones[i / CHAR_BIT] >> (i % CHAR_BIT) & 1;
+}
+
+size_t get_num_live_blocks(const BlockArray *array)
+{
+    return array->length - array->num_tombstones;
+}
+
+/* append_block: The caller makes sure bid is not in the array yet.
+ */
+int append_block(BlockArray *array, unsigned int bid)
 {
-    Block *block = malloc(sizeof (Block));
-    if (!block) return NULL;
-    block->id = bid;
-    block->prev = NULL;
-    block->next = NULL;
-    return block;
+    if (array->length == UINT_INDEX_NONE) return EXIT_FAILURE;
+    if (array->length == array->capacity
+            && reserve(array, array->capacity ? array->capacity * 2 : BLOCK_ARRAY_MIN_CAPACITY)) {
+        return EXIT_FAILURE;
+    }
+    if (uint_index_put(&array->index, bid, array->length)) return EXIT_FAILURE;
+    array->slots[array->length++].id = bid;
+    return EXIT_SUCCESS;
 }
 
-Block *clone_chain(const Block *head)
+/* append_blocks: Appends count blocks read from a plain slot array. On
+ * failure, the array is left as it was.
+ */
+int append_blocks(BlockArray *array, const Block *blocks, size_t count)
 {
-    Block clone_dummy_head = create_block(0);
-    Block *clone = &clone_dummy_head;
-    while (head) {
-        clone = clone_block(head, clone);
-        if (!clone) return NULL;
-        head = head->next;
+    size_t length = array->length;
+    if (length + count > array->capacity
+            && reserve(array, length + count > array->capacity * 2 ? length + count : array->capacity * 2)) {
+        return EXIT_FAILURE;
     }
-    clone = clone_dummy_head.next;
-    clone->prev = NULL;
-    return clone;
+    for (size_t i = 0; i < count; i++) {
+        if (append_block(array, blocks[i].id)) {
+            truncate_block_array(array, length);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
-Block create_block(unsigned int bid)
+/* append_live_blocks: Appends every block of source, skipping tombstones.
+ * On failure, the array is left as it was.
+ */
+int append_live_blocks(BlockArray *array, const BlockArray *source)
 {
-    Block block = {.id = bid};
-    return block;
+    size_t length = array->length;
+    for (Block *block = get_live_block(source, 0); block;
+         block = get_live_block(source, block - source->slots + 1)) {
+        if (append_block(array, block->id)) {
+            truncate_block_array(array, length);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
-Block *clone_block(const Block *block, Block *prev)
+/* remove_block: The last block is popped along with any tombstones before
+ * it; any other block becomes a tombstone.
+ */
+void remove_block(BlockArray *array, Block *block)
 {
-    Block *clone = new_block(block->id);
-    if (!clone) return NULL;
-    prev->next = clone;
-    clone->prev = prev;
-    return clone;
+    uint_index_remove(&array->index, block->id);
+    size_t i = block - array->slots;
+    if (i + 1 < array->length) {
+        set_tombstone(array, i);
+        return;
+    }
+    array->length--;
+    trim_tombstones(array);
 }
 
-Block *get_chain_tail(Block *head)
+/* truncate_block_array: Drops every slot from length onwards. The array may
+ * end up shorter than length if tombstones precede the cut.
+ */
+void truncate_block_array(BlockArray *array, size_t length)
 {
-    while (head->next) {
-        head = head->next;
+    for (size_t i = length; i < array->length; i++) {
+        if (is_tombstone(array, i)) {
+            clear_tombstone(array, i);
+        } else {
+            uint_index_remove(&array->index, array->slots[i].id);
+        }
+    }
+    if (length < array->length) {
+        array->length = length;
+        trim_tombstones(array);
     }
-    return head;
 }
 
-void free_block(Block *block)
+bool needs_compaction(const BlockArray *array)
+{
+    return array->num_tombstones >= COMPACTION_MIN_TOMBSTONES
+           && array->num_tombstones * 2 >= array->length;
+}
+
+/* compact_block_array: Squeezes the tombstones out. Returns the number of
+ * live blocks that were before slot boundary, which is where that boundary
+ * lies after compaction.
+ */
+size_t compact_block_array(BlockArray *array, size_t boundary)
+{
+    size_t live = 0;
+    size_t new_boundary = 0;
+    for (size_t i = 0; i < array->length; i++) {
+        if (i == boundary) {
+            new_boundary = live;
+        }
+        if (is_tombstone(array, i)) continue;
+        if (i < array->num_holder_positions) {
+            array->holder_positions[live] = array->holder_positions[i];
+        }
+        array->slots[live++] = array->slots[i];
+    }
+    if (boundary >= array->length) {
+        new_boundary = live;
+    }
+    memset(array->tombstones, 0, bitmap_size(array->length));
+    array->length = live;
+    array->num_tombstones = 0;
+    reindex(array);
+    return new_boundary;
+}
+
+void free_block_array(BlockArray *array)
+{
+    MemKind kind = array->index.kind;
+    free(array->slots);
+    free(array->tombstones);
+    mem_uncharge(kind, get_size(array->capacity));
+    mem_free(MEM_INDEXES, array->holder_positions,
+             array->num_holder_positions * sizeof (unsigned int));
+    free_uint_index(&array->index);
+    *array = create_block_array_of(kind);
+}
+
+SharedBlocks *new_shared_blocks()
+{
+    SharedBlocks *shared = mem_alloc(MEM_BLOCKS, sizeof (SharedBlocks));
+    if (!shared) return NULL;
+    shared->blocks = create_block_array();
+    atomic_init(&shared->num_refs, 1);
+    shared->derived = NULL;
+    shared->sharing_nodes = NULL;
+    shared->held_generation = 0;
+    return shared;
+}
+
+SharedBlocks *acquire_shared_blocks(SharedBlocks *shared)
+{
+    atomic_fetch_add(&shared->num_refs, 1);
+    return shared;
+}
+
+/* acquire_shared_blocks_without: Returns a reference to the sequence of
+ * shared without block, building it only if the last node to remove a
+ * block from shared removed a different one. shared must hold more than
+ * this one block.
+ */
+SharedBlocks *acquire_shared_blocks_without(SharedBlocks *shared, const Block *block)
+{
+    if (shared->derived && shared->derived_without == block->id) {
+        return acquire_shared_blocks(shared->derived);
+    }
+    SharedBlocks *derived = new_shared_blocks();
+    if (!derived) return NULL;
+    size_t i = block - shared->blocks.slots;
+    BlockArray *blocks = &shared->blocks;
+    if (append_blocks(&derived->blocks, blocks->slots, i)
+            || append_blocks(&derived->blocks, block + 1, blocks->length - i - 1)) {
+        release_shared_blocks(derived);
+        return NULL;
+    }
+    if (shared->derived) {
+        release_shared_blocks(shared->derived);
+    }
+    shared->derived = acquire_shared_blocks(derived);
+    shared->derived_without = block->id;
+    return derived;
+}
+
+/* new_shared_blocks_without_ids: Returns a new sequence holding the blocks
+ * of shared whose ids are not keys of ids.
+ */
+SharedBlocks *new_shared_blocks_without_ids(const SharedBlocks *shared, const UintIndex *ids)
+{
+    SharedBlocks *derived = new_shared_blocks();
+    if (!derived) return NULL;
+    for (size_t i = 0; i < shared->blocks.length; i++) {
+        unsigned int bid = shared->blocks.slots[i].id;
+        if (uint_index_get(ids, bid) == UINT_INDEX_NONE && append_block(&derived->blocks, bid)) {
+            release_shared_blocks(derived);
+            return NULL;
+        }
+    }
+    return derived;
+}
+
+void release_shared_blocks(SharedBlocks *shared)
+{
+    while (shared && atomic_fetch_sub(&shared->num_refs, 1) == 1) {
+        SharedBlocks *derived = shared->derived;
+        free_block_array(&shared->blocks);
+        mem_free(MEM_BLOCKS, shared, sizeof (SharedBlocks));
+        shared = derived;
+    }
+}
+
+/* reserve: Grows the slots and the tombstone bitmap together, so that
+ * removals never have to allocate. Both are charged at once, as counted by
+ * the capacity, which only changes if both grow.
+ */
+int reserve(BlockArray *array, size_t capacity)
+{
+    size_t growth = get_size(capacity) - get_size(array->capacity);
+    if (mem_charge(array->index.kind, growth)) return EXIT_FAILURE;
+    Block *slots = realloc(array->slots, capacity * sizeof (Block));
+    if (!slots) {
+        mem_uncharge(array->index.kind, growth);
+        return EXIT_FAILURE;
+    }
+    array->slots = slots;
+    size_t old_size = bitmap_size(array->capacity);
+    size_t size = bitmap_size(capacity);
+    unsigned char *tombstones = realloc(array->tombstones, size);
+    if (!tombstones) {
+        mem_uncharge(array->index.kind, growth);
+        return EXIT_FAILURE;
+    }
+    memset(tombstones + old_size, 0, size - old_size);
+    array->tombstones = tombstones;
+    array->capacity = capacity;
+    return EXIT_SUCCESS;
+}
+
+/* get_size: The bytes taken by the slots and the tombstone bitmap of an
+ * array of that capacity.
+ */
+size_t get_size(size_t capacity)
+{
+    return capacity * sizeof (Block) + bitmap_size(capacity);
+}
+
+size_t bitmap_size(size_t capacity)
+{
+    return (capacity + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+/* reindex: Updates the positions after compaction moved the slots. Every
+ * live id is already a key, so this only overwrites positions and cannot
+ * fail.
+ */
+void reindex(BlockArray *array)
+{
+    for (size_t i = 0; i < array->length; i++) {
+        uint_index_put(&array->index, array->slots[i].id, i);
+    }
+}
+
+void set_tombstone(BlockArray *array, size_t i)
+{
+    array->tombstones[i / CHAR_BIT] |= 1 << (i % CHAR_BIT);
+    array->num_tombstones++;
+}
+
+void clear_tombstone(BlockArray *array, size_t i)
 {
-    free(block);
+    array->tombstones[i / CHAR_BIT] &= ~(1 << (i % CHAR_BIT));
+    array->num_tombstones--;
 }
 
-void free_chain(Block *head)
+void trim_tombstones(BlockArray *array)
 {
-    while (head) {
-        Block *current = head;
-        head = current->next;
-        free_block(current);
+    while (array->length && is_tombstone(array, array->length - 1)) {
+        clear_tombstone(array, --array->length);
     }
 }
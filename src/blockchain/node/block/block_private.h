@@ -2,10 +2,27 @@
 #define BLOCK_H
 
 #include "block_public.h"
+#include <stdbool.h>
 
-Block *clone_chain(const Block *head);
-Block *get_chain_tail(Block *head);
-void free_block(Block *block);
-void free_chain(Block *head);
+BlockArray create_block_array();
+BlockArray create_block_array_of(MemKind kind);
+Block *get_block(const BlockArray *array, unsigned int bid);
+Block *get_live_block(const BlockArray *array, size_t from);
+bool is_tombstone(const BlockArray *array, size_t i);
+size_t get_num_live_blocks(const BlockArray *array);
+int append_block(BlockArray *array, unsigned int bid);
+int append_blocks(BlockArray *array, const Block *blocks, size_t count);
+void remove_block(BlockArray *array, Block *block);
+void truncate_block_array(BlockArray *array, size_t length);
+bool needs_compaction(const BlockArray *array);
+size_t compact_block_array(BlockArray *array, size_t boundary);
+int append_live_blocks(BlockArray *array, const BlockArray *source);
+void free_block_array(BlockArray *array);
+
+SharedBlocks *new_shared_blocks();
+SharedBlocks *acquire_shared_blocks(SharedBlocks *shared);
+SharedBlocks *acquire_shared_blocks_without(SharedBlocks *shared, const Block *block);
+SharedBlocks *new_shared_blocks_without_ids(const SharedBlocks *shared, const UintIndex *ids);
+void release_shared_blocks(SharedBlocks *shared);
 
 #endif
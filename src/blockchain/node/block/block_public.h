@@ -1,12 +1,58 @@
 #ifndef BLOCK_PUBLIC_H
 #define BLOCK_PUBLIC_H
 
+#include "../../../utils/uint_index.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+struct s_node;
+
 typedef struct s_block {
     unsigned int id;
-    struct s_block *prev;
-    struct s_block *next;
 } Block;
 
-Block *new_block(unsigned int bid);
+/* A node's blocks, in insertion order, stored contiguously. Removing a block
+ * from the middle leaves a tombstone (a set bit in the tombstones bitmap)
+ * until the array is compacted, so that removals stay O(1). The array never
+ * ends with a tombstone. The index maps each live block id to its slot.
+ * The whole array is accounted as memory of the kind of its index.
+ *
+ * holder_positions is a side array of BlockHolders, which it allocates the
+ * first time it holds a block of the array: the position of each slot's
+ * block in the list of holders of its id. Arrays that are never held, and
+ * every array until where is first used, go without. Compaction moves the
+ * positions along with the slots.
+ */
+typedef struct s_block_array {
+    Block *slots;
+    unsigned char *tombstones;
+    unsigned int *holder_positions;
+    size_t length;
+    size_t capacity;
+    size_t num_holder_positions;
+    size_t num_tombstones;
+    UintIndex index;
+} BlockArray;
+
+/* An immutable, reference-counted BlockArray without tombstones, shared by
+ * every node whose blocks start with the same synchronized sequence. Nodes
+ * never modify it: to remove one of its blocks, a node switches to derived,
+ * the same sequence without block derived_without. derived is kept so that
+ * the next node removing that block can share it too. num_refs is atomic
+ * because a parallel sync releases and acquires shared blocks from several
+ * threads at once.
+ *
+ * Only the bookkeeping of BlockHolders changes: sharing_nodes lists the
+ * tracked nodes sharing the blocks, while they are held as of generation
+ * held_generation.
+ */
+typedef struct s_shared_blocks {
+    BlockArray blocks;
+    atomic_size_t num_refs;
+    struct s_shared_blocks *derived;
+    unsigned int derived_without;
+    struct s_node *sharing_nodes;
+    unsigned long held_generation;
+} SharedBlocks;
 
 #endif
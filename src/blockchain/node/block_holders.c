@@ -0,0 +1,135 @@
+#include "block_holders.h"
+#include "node_public.h"
+#include "block/block_private.h"
+#include "../../utils/mem.h"
+#include <stdlib.h>
+
+#define BLOCK_HOLDER_LIST_MIN_CAPACITY 2
+
+static BlockArray *get_held_blocks(BlockHolder holder);
+static unsigned int *get_holder_position(BlockHolder holder, const Block *block);
+static int reserve_holder_positions(BlockArray *blocks);
+static BlockHolderList *get_or_add_list(BlockHolders *holders, unsigned int bid);
+static int grow_list(BlockHolderList *list);
+static void free_list(BlockHolderList *list);
+
+const BlockHolderList *get_block_holder_list(const BlockHolders *holders, unsigned int bid)
+{
+    return uint_map_get(&holders->lists, bid);
+}
+
+/* hold_block: Adds holder, which stores block, to the holders of block's
+ * id. On failure, the index is emptied instead.
+ */
+void hold_block(BlockHolders *holders, const Block *block, BlockHolder holder)
+{
+    if (!holders->is_complete) return;
+    BlockHolderList *list = get_or_add_list(holders, block->id);
+    if (!list || (list->length == list->capacity && grow_list(list))
+            || reserve_holder_positions(get_held_blocks(holder))) {
+        reset_block_holders(holders, false);
+        return;
+    }
+    *get_holder_position(holder, block) = list->length;
+    list->holders[list->length++] = holder;
+}
+
+/* release_block: Removes holder, which stores block, from the holders of
+ * block's id. The last holder takes its place, so its own block moves with
+ * it.
+ */
+void release_block(BlockHolders *holders, const Block *block, BlockHolder holder)
+{
+    if (!holders->is_complete) return;
+    BlockHolderList *list = uint_map_get(&holders->lists, block->id);
+    unsigned int position = *get_holder_position(holder, block);
+    list->holders[position] = list->holders[--list->length];
+    if (position < list->length) {
+        BlockHolder moved = list->holders[position];
+        *get_holder_position(moved, get_block(get_held_blocks(moved), block->id)) = position;
+    }
+    if (!list->length) {
+        uint_map_remove(&holders->lists, block->id);
+        free_list(list);
+    }
+}
+
+/* reset_block_holders: Empties the index and starts a new generation. An
+ * incomplete index ignores every change until it is reset as complete.
+ */
+void reset_block_holders(BlockHolders *holders, bool is_complete)
+{
+    for (size_t i = 0; i < holders->lists.capacity; i++) {
+        BlockHolderList *list = holders->lists.slots[i].value;
+        if (list) {
+            free_list(list);
+        }
+    }
+    free_uint_map(&holders->lists);
+    holders->is_complete = is_complete;
+    holders->generation++;
+}
+
+void free_block_holders(BlockHolders *holders)
+{
+    reset_block_holders(holders, false);
+}
+
+BlockArray *get_held_blocks(BlockHolder holder)
+{
+    return holder.node ? &holder.node->blocks : &holder.shared->blocks;
+}
+
+unsigned int *get_holder_position(BlockHolder holder, const Block *block)
+{
+    BlockArray *blocks = get_held_blocks(holder);
+    return &blocks->holder_positions[block - blocks->slots];
+}
+
+/* reserve_holder_positions: Gives every slot of blocks a holder position,
+ * allocating them the first time blocks are held, and as the slots grow.
+ */
+int reserve_holder_positions(BlockArray *blocks)
+{
+    if (blocks->num_holder_positions >= blocks->capacity) return EXIT_SUCCESS;
+    unsigned int *positions = mem_realloc(MEM_INDEXES, blocks->holder_positions,
+                                          blocks->num_holder_positions * sizeof (unsigned int),
+                                          blocks->capacity * sizeof (unsigned int));
+    if (!positions) return EXIT_FAILURE;
+    blocks->holder_positions = positions;
+    blocks->num_holder_positions = blocks->capacity;
+    return EXIT_SUCCESS;
+}
+
+BlockHolderList *get_or_add_list(BlockHolders *holders, unsigned int bid)
+{
+    BlockHolderList *list = uint_map_get(&holders->lists, bid);
+    if (list) return list;
+    list = mem_alloc(MEM_INDEXES, sizeof (BlockHolderList));
+    if (!list) return NULL;
+    list->holders = NULL;
+    list->length = list->capacity = 0;
+    if (uint_map_put(&holders->lists, bid, list)) {
+        free_list(list);
+        return NULL;
+    }
+    return list;
+}
+
+int grow_list(BlockHolderList *list)
+{
+    unsigned int capacity = list->capacity ? list->capacity * 2 : BLOCK_HOLDER_LIST_MIN_CAPACITY;
+    BlockHolder *holders = mem_realloc(MEM_INDEXES, list->holders,
+                                       list->capacity * sizeof (BlockHolder),
+                                       capacity * sizeof (BlockHolder));
+    if (!holders) return EXIT_FAILURE;
+    list->holders = holders;
+    list->capacity = capacity;
+    return EXIT_SUCCESS;
+}
+
+void free_list(BlockHolderList *list)
+{
+    mem_free(MEM_INDEXES, list->holders, list->capacity * sizeof (BlockHolder));
+    mem_free(MEM_INDEXES, list, sizeof (BlockHolderList));
+}
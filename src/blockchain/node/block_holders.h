@@ -0,0 +1,42 @@
+#ifndef BLOCK_HOLDERS_H
+#define BLOCK_HOLDERS_H
+
+#include "block/block_public.h"
+#include "../../utils/uint_map.h"
+#include <stdbool.h>
+
+/* Either a node, for the blocks it stores itself, or a sequence of shared
+ * blocks, on behalf of every node sharing it.
+ */
+typedef struct s_block_holder {
+    struct s_node *node;
+    SharedBlocks *shared;
+} BlockHolder;
+
+typedef struct s_block_holder_list {
+    BlockHolder *holders;
+    unsigned int length;
+    unsigned int capacity;
+} BlockHolderList;
+
+/* Inverted index from each block id to the holders of a block with that
+ * id. The holder_positions of each held BlockArray record where its blocks
+ * are in their holder lists, so that releasing a block takes constant time.
+ *
+ * The index is only a cache. It is built on first use, and if it runs out
+ * of memory, it empties itself and stops following changes until it is
+ * rebuilt. Each rebuild starts a new generation.
+ */
+typedef struct s_block_holders {
+    UintMap lists;
+    bool is_complete;
+    unsigned long generation;
+} BlockHolders;
+
+const BlockHolderList *get_block_holder_list(const BlockHolders *holders, unsigned int bid);
+void hold_block(BlockHolders *holders, const Block *block, BlockHolder holder);
+void release_block(BlockHolders *holders, const Block *block, BlockHolder holder);
+void reset_block_holders(BlockHolders *holders, bool is_complete);
+void free_block_holders(BlockHolders *holders);
+
+#endif
@@ -1,160 +1,718 @@
 #include "node_private.h"
 #include "block/block_private.h"
+#include "../../utils/mem.h"
 #include <stdlib.h>
 
-static Block dummy_head;
-static Block dummy_tail;
+static size_t get_shared_length(const Node *node);
+static size_t get_length(const Node *node);
+static bool is_shared_block(const Node *node, const Block *block);
+static Block *get_live_block_from(const Node *node, size_t from);
+static int keep_shared_prefix(Node *node, size_t length);
+static int rmv_shared_block(Block *block, Node *node);
+static void rmv_private_block(Block *block, Node *node);
+static int rmv_shared_blocks(BlockRemoval *removal, Node *node, size_t *num_removed);
+static int derive_removal(BlockRemoval *removal, SharedBlocks *shared);
+static size_t count_removed_before(const BlockRemoval *removal, const Node *node, size_t end);
+static size_t rmv_private_blocks(const BlockRemoval *removal, Node *node);
+static void compact_if_needed(Node *node);
+static bool have_same_blocks(const BlockArray *array, const BlockArray *other);
+static void replace_shared_blocks(Node *node, SharedBlocks *shared);
+static bool is_held(const Node *node);
+static void hold_own_blocks_from(Node *node, size_t from);
+static void release_own_blocks_from(Node *node, size_t from);
+static void release_own_block(Node *node, const Block *block);
+static void link_shared_blocks(Node *node);
+static void unlink_shared_blocks(Node *node);
+static void before_change(const Node *node);
+static void after_change(Node *node);
+static void mark_dirty(Node *node);
+static void unmark_dirty(Node *node);
 
-static void add_first_block(Block *block, Node *node);
-static void add_first_chain(Block *head, Block *tail, Node *node);
-static void attach_dummy_head_and_tail(Node *node);
-static void detach_dummy_head_and_tail(Node *node);
-static bool node_has_one_block(const Node *node);
-
-Node *new_node(unsigned int nid)
+/* init_node: Makes node, allocated by the blockchain, an empty node with
+ * id nid.
+ */
+void init_node(Node *node, unsigned int nid)
 {
-    Node *node = malloc(sizeof (Node));
-    if (!node) return NULL;
     node->id = nid;
-    node->head = node->sync_tail = node->tail = NULL;
+    node->shared = NULL;
+    node->prev_sharing = node->next_sharing = NULL;
+    node->blocks = create_block_array();
+    node->sync_length = 0;
+    node->tracker = NULL;
+    node->is_dirty = false;
+    node->prev_dirty = node->next_dirty = NULL;
+    node->is_unsaved = true;
+    node->next_is_tallied = false;
     node->prev = node->next = NULL;
-    return node;
 }
 
-Node create_node(unsigned int nid)
+bool has_block_with_id(unsigned int bid, const Node *node)
 {
-    Node node = {
-            .id = nid,
-            .head = NULL,
-            .sync_tail = NULL,
-            .tail = NULL,
-            .prev = NULL,
-            .next = NULL
-    };
-    return node;
+    return get_block_from_id(bid, node) != NULL;
 }
 
-bool has_block_with_id(unsigned int bid, Node *node)
+/* get_block_from_id: The returned block lives in the node's storage. It
+ * stays valid until the node is next modified.
+ */
+Block *get_block_from_id(unsigned int bid, const Node *node)
 {
-    return get_block_from_id(bid, node) != NULL;
+    Block *block = get_block(&node->blocks, bid);
+    if (!block && node->shared) {
+        block = get_block(&node->shared->blocks, bid);
+    }
+    return block;
+}
+
+Block *first_block(const Node *node)
+{
+    return get_live_block_from(node, 0);
+}
+
+Block *next_block(const Node *node, const Block *block)
+{
+    return get_live_block_from(node, get_block_position(node, block) + 1);
+}
+
+size_t get_num_blocks(const Node *node)
+{
+    return get_shared_length(node) + get_num_live_blocks(&node->blocks);
 }
 
-Block *get_block_from_id(unsigned int bid, Node *node)
+/* add_block: The caller makes sure the node has no block bid yet.
+ */
+int add_block(unsigned int bid, Node *node)
 {
-    Block *block = node->head;
-    while (block && block->id != bid) {
-        block = block->next;
+    before_change(node);
+    size_t length = node->blocks.length;
+    int status = append_block(&node->blocks, bid);
+    if (!status) {
+        hold_own_blocks_from(node, length);
     }
-    return block;
+    after_change(node);
+    return status;
+}
+
+/* Positions count the shared blocks first, then the node's own slots,
+ * tombstones included.
+ */
+size_t get_shared_length(const Node *node)
+{
+    return node->shared ? node->shared->blocks.length : 0;
+}
+
+size_t get_length(const Node *node)
+{
+    return get_shared_length(node) + node->blocks.length;
+}
+
+bool is_shared_block(const Node *node, const Block *block)
+{
+    return node->shared && block >= node->shared->blocks.slots
+           && block < node->shared->blocks.slots + node->shared->blocks.length;
+}
+
+size_t get_block_position(const Node *node, const Block *block)
+{
+    if (is_shared_block(node, block)) {
+        return block - node->shared->blocks.slots;
+    }
+    return get_shared_length(node) + (block - node->blocks.slots);
+}
+
+Block *get_live_block_from(const Node *node, size_t from)
+{
+    size_t shared_length = get_shared_length(node);
+    if (from < shared_length) {
+        return &node->shared->blocks.slots[from];
+    }
+    return get_live_block(&node->blocks, from - shared_length);
+}
+
+Block *get_first_post_sync_block(const Node *node)
+{
+    return get_live_block_from(node, node->sync_length);
+}
+
+/* rmv_post_sync_blocks: If the sync boundary lies within the shared blocks,
+ * the node stops sharing them and keeps a private copy of the ones before
+ * the boundary. On failure, the node is left unchanged.
+ */
+int rmv_post_sync_blocks(Node *node)
+{
+    size_t shared_length = get_shared_length(node);
+    before_change(node);
+    int status = EXIT_SUCCESS;
+    if (node->sync_length >= shared_length) {
+        release_own_blocks_from(node, node->sync_length - shared_length);
+        truncate_block_array(&node->blocks, node->sync_length - shared_length);
+    } else {
+        status = keep_shared_prefix(node, node->sync_length);
+    }
+    if (node->sync_length > get_length(node)) {
+        node->sync_length = get_length(node);
+    }
+    after_change(node);
+    return status;
+}
+
+int keep_shared_prefix(Node *node, size_t length)
+{
+    BlockArray prefix = create_block_array();
+    if (append_blocks(&prefix, node->shared->blocks.slots, length)) {
+        free_block_array(&prefix);
+        return EXIT_FAILURE;
+    }
+    release_own_blocks_from(node, 0);
+    replace_shared_blocks(node, NULL);
+    free_block_array(&node->blocks);
+    node->blocks = prefix;
+    hold_own_blocks_from(node, 0);
+    return EXIT_SUCCESS;
+}
+
+/* add_blocks: On failure, the node is left unchanged.
+ */
+int add_blocks(const Block *blocks, size_t num_blocks, Node *node)
+{
+    before_change(node);
+    size_t length = node->blocks.length;
+    int status = append_blocks(&node->blocks, blocks, num_blocks);
+    if (!status) {
+        hold_own_blocks_from(node, length);
+    }
+    after_change(node);
+    return status;
 }
 
-void add_block(Block *block, Node *node)
+/* new_synced_blocks: Returns the blocks of node followed by num_blocks more
+ * blocks, as a sequence that nodes can share.
+ */
+SharedBlocks *new_synced_blocks(const Node *node, const Block *blocks, size_t num_blocks)
 {
-    if (node_is_empty(node)) {
-        add_first_block(block, node);
-        return;
+    SharedBlocks *synced = new_shared_blocks();
+    if (!synced) return NULL;
+    if ((node->shared && append_blocks(&synced->blocks, node->shared->blocks.slots,
+                                       node->shared->blocks.length))
+            || append_live_blocks(&synced->blocks, &node->blocks)
+            || append_blocks(&synced->blocks, blocks, num_blocks)) {
+        release_shared_blocks(synced);
+        return NULL;
     }
-    block->prev = node->tail;
-    node->tail = node->tail->next = block;
+    return synced;
+}
+
+/* set_shared_blocks: Replaces the blocks of node with shared, which are
+ * synchronized by definition.
+ */
+void set_shared_blocks(Node *node, SharedBlocks *shared)
+{
+    before_change(node);
+    release_own_blocks_from(node, 0);
+    free_block_array(&node->blocks);
+    replace_shared_blocks(node, acquire_shared_blocks(shared));
+    node->sync_length = shared->blocks.length;
+    after_change(node);
 }
 
-void add_first_block(Block *block, Node *node)
+/* clear_node: Removes every block of node.
+ */
+void clear_node(Node *node)
 {
-    node->head = node->tail = block;
+    before_change(node);
+    release_own_blocks_from(node, 0);
+    free_block_array(&node->blocks);
+    replace_shared_blocks(node, NULL);
+    node->sync_length = 0;
+    after_change(node);
 }
 
-Block *get_post_sync_chain(const Node *node)
+/* set_own_blocks: Replaces the blocks of node that it does not share with
+ * blocks, which it takes over, leaving blocks empty. The sync boundary is
+ * left as it is.
+ */
+void set_own_blocks(Node *node, BlockArray *blocks)
 {
-    return node->sync_tail ? node->sync_tail->next : node->head;
+    before_change(node);
+    release_own_blocks_from(node, 0);
+    free_block_array(&node->blocks);
+    node->blocks = *blocks;
+    *blocks = create_block_array();
+    hold_own_blocks_from(node, 0);
+    after_change(node);
 }
 
-void add_chain(Block *head, Node *node)
+bool node_has_same_blocks(const Node *node, const Node *other)
 {
-    Block *tail = get_chain_tail(head);
-    if (node_is_empty(node)) {
-        add_first_chain(head, tail, node);
-        return;
+    if (node->shared == other->shared) {
+        return have_same_blocks(&node->blocks, &other->blocks);
     }
-    head->prev = node->tail;
-    node->tail->next = head;
-    node->tail = tail;
+    if (get_num_blocks(node) != get_num_blocks(other)) return false;
+    Block *block = first_block(node);
+    Block *other_block = first_block(other);
+    for (; block; block = next_block(node, block), other_block = next_block(other, other_block)) {
+        if (block->id != other_block->id) return false;
+    }
+    return true;
 }
 
-void add_first_chain(Block *head, Block *tail, Node *node)
+bool have_same_blocks(const BlockArray *array, const BlockArray *other)
 {
-    node->head = head;
-    node->tail = tail;
+    if (get_num_live_blocks(array) != get_num_live_blocks(other)) return false;
+    Block *block = get_live_block(array, 0);
+    Block *other_block = get_live_block(other, 0);
+    while (block) {
+        if (block->id != other_block->id) return false;
+        block = get_live_block(array, block - array->slots + 1);
+        other_block = get_live_block(other, other_block - other->slots + 1);
+    }
+    return true;
 }
 
-void rmv_block(Block *block, Node *node)
+/* rmv_block: Fails only if the node has to stop sharing blocks and cannot
+ * allocate the sequence it switches to.
+ */
+int rmv_block(Block *block, Node *node)
 {
-    if (node_is_empty(node) || node_has_one_block(node)) {
-        free_block(block);
-        node->head = node->tail = node->sync_tail = NULL;
-        return;
+    before_change(node);
+    int status = EXIT_SUCCESS;
+    if (is_shared_block(node, block)) {
+        status = rmv_shared_block(block, node);
+    } else {
+        rmv_private_block(block, node);
     }
-    attach_dummy_head_and_tail(node);
-    block->prev->next = block->next;
-    block->next->prev = block->prev;
-    if (node->sync_tail == block) {
-        node->sync_tail = block->prev;
+    after_change(node);
+    return status;
+}
+
+int rmv_shared_block(Block *block, Node *node)
+{
+    SharedBlocks *shared = NULL;
+    if (node->shared->blocks.length > 1) {
+        shared = acquire_shared_blocks_without(node->shared, block);
+        if (!shared) return EXIT_FAILURE;
     }
-    detach_dummy_head_and_tail(node);
-    free_block(block);
+    size_t position = block - node->shared->blocks.slots;
+    replace_shared_blocks(node, shared);
+    if (position < node->sync_length) {
+        node->sync_length--;
+    }
+    return EXIT_SUCCESS;
+}
+
+void rmv_private_block(Block *block, Node *node)
+{
+    release_own_block(node, block);
+    remove_block(&node->blocks, block);
+    if (node->sync_length > get_length(node)) {
+        node->sync_length = get_length(node);
+    }
+    compact_if_needed(node);
 }
 
-void attach_dummy_head_and_tail(Node *node)
+int create_block_removal(BlockRemoval *removal, const unsigned int *bids, size_t num_bids)
 {
-    node->head->prev = &dummy_head;
-    dummy_head.next = node->head;
+    removal->ids = mem_alloc(MEM_SCRATCH, num_bids * sizeof (unsigned int));
+    removal->num_ids = 0;
+    removal->max_ids = num_bids;
+    removal->id_set = create_uint_index_of(MEM_SCRATCH);
+    removal->shared = removal->derived = NULL;
+    if (num_bids && !removal->ids) return EXIT_FAILURE;
+    for (size_t i = 0; i < num_bids; i++) {
+        if (uint_index_get(&removal->id_set, bids[i]) != UINT_INDEX_NONE) continue;
+        if (uint_index_put(&removal->id_set, bids[i], 0)) {
+            free_block_removal(removal);
+            return EXIT_FAILURE;
+        }
+        removal->ids[removal->num_ids++] = bids[i];
+    }
+    return EXIT_SUCCESS;
+}
 
-    node->tail->next = &dummy_tail;
-    dummy_tail.prev = node->tail;
+/* rmv_blocks: Removes from node every block whose id is in removal, and
+ * adds their number to num_removed. Fails only if the node has to stop
+ * sharing blocks and cannot allocate the sequence it switches to; its own
+ * blocks are then left untouched.
+ */
+int rmv_blocks(BlockRemoval *removal, Node *node, size_t *num_removed)
+{
+    before_change(node);
+    int status = rmv_shared_blocks(removal, node, num_removed);
+    if (!status) {
+        *num_removed += rmv_private_blocks(removal, node);
+    }
+    after_change(node);
+    return status;
+}
+
+int rmv_shared_blocks(BlockRemoval *removal, Node *node, size_t *num_removed)
+{
+    if (!node->shared) return EXIT_SUCCESS;
+    if (node->shared != removal->shared && derive_removal(removal, node->shared)) {
+        return EXIT_FAILURE;
+    }
+    size_t shared_length = get_shared_length(node);
+    size_t removed = shared_length - removal->derived->blocks.length;
+    if (!removed) return EXIT_SUCCESS;
+    size_t removed_before_sync = node->sync_length >= shared_length
+                                 ? removed : count_removed_before(removal, node, node->sync_length);
+    replace_shared_blocks(node, removal->derived->blocks.length
+                                ? acquire_shared_blocks(removal->derived) : NULL);
+    node->sync_length -= removed_before_sync;
+    *num_removed += removed;
+    return EXIT_SUCCESS;
+}
+
+/* derive_removal: Makes shared the sequence removal last derived from. The
+ * removal holds a reference to it, so that no other sequence can take its
+ * address while the removal runs.
+ */
+int derive_removal(BlockRemoval *removal, SharedBlocks *shared)
+{
+    SharedBlocks *derived = new_shared_blocks_without_ids(shared, &removal->id_set);
+    if (!derived) return EXIT_FAILURE;
+    release_shared_blocks(removal->shared);
+    release_shared_blocks(removal->derived);
+    removal->shared = acquire_shared_blocks(shared);
+    removal->derived = derived;
+    return EXIT_SUCCESS;
+}
+
+/* count_removed_before: Counts the shared blocks of node before position
+ * end that removal removes.
+ */
+size_t count_removed_before(const BlockRemoval *removal, const Node *node, size_t end)
+{
+    size_t count = 0;
+    if (removal->num_ids < end) {
+        for (size_t i = 0; i < removal->num_ids; i++) {
+            Block *block = get_block(&node->shared->blocks, removal->ids[i]);
+            count += block && (size_t) (block - node->shared->blocks.slots) < end;
+        }
+        return count;
+    }
+    for (size_t i = 0; i < end; i++) {
+        count += uint_index_get(&removal->id_set, node->shared->blocks.slots[i].id)
+                 != UINT_INDEX_NONE;
+    }
+    return count;
 }
 
-void detach_dummy_head_and_tail(Node *node)
+size_t rmv_private_blocks(const BlockRemoval *removal, Node *node)
 {
-    node->head = dummy_head.next;
-    node->head->prev = NULL;
-    if (&dummy_head == node->sync_tail) {
-        node->sync_tail = NULL;
+    BlockArray *blocks = &node->blocks;
+    size_t removed = 0;
+    if (removal->num_ids < get_num_live_blocks(blocks)) {
+        for (size_t i = 0; i < removal->num_ids; i++) {
+            Block *block = get_block(blocks, removal->ids[i]);
+            if (block) {
+                release_own_block(node, block);
+                remove_block(blocks, block);
+                removed++;
+            }
+        }
+    } else {
+        Block *block = get_live_block(blocks, 0);
+        while (block) {
+            size_t next = block - blocks->slots + 1;
+            if (uint_index_get(&removal->id_set, block->id) != UINT_INDEX_NONE) {
+                release_own_block(node, block);
+                remove_block(blocks, block);
+                removed++;
+            }
+            block = get_live_block(blocks, next);
+        }
+    }
+    if (node->sync_length > get_length(node)) {
+        node->sync_length = get_length(node);
     }
+    compact_if_needed(node);
+    return removed;
+}
+
+void free_block_removal(BlockRemoval *removal)
+{
+    release_shared_blocks(removal->shared);
+    release_shared_blocks(removal->derived);
+    free_uint_index(&removal->id_set);
+    mem_free(MEM_SCRATCH, removal->ids, removal->max_ids * sizeof (unsigned int));
+    removal->ids = NULL;
+    removal->num_ids = removal->max_ids = 0;
+    removal->shared = removal->derived = NULL;
+}
 
-    node->tail = dummy_tail.prev;
-    node->tail->next = NULL;
+void compact_if_needed(Node *node)
+{
+    if (!needs_compaction(&node->blocks)) return;
+    size_t shared_length = get_shared_length(node);
+    if (node->sync_length > shared_length) {
+        node->sync_length = shared_length
+                + compact_block_array(&node->blocks, node->sync_length - shared_length);
+    } else {
+        compact_block_array(&node->blocks, 0);
+    }
 }
 
 bool node_is_synced(const Node *node)
 {
-    return node->sync_tail == node->tail;
+    return node->sync_length == get_length(node);
 }
 
 void declare_node_synced(Node *node)
 {
-    node->sync_tail = node->tail;
+    set_sync_length(node, get_length(node));
+}
+
+void set_sync_length(Node *node, size_t sync_length)
+{
+    before_change(node);
+    node->sync_length = sync_length;
+    after_change(node);
+}
+
+/* attach_tracker: From now on, node keeps tracker up to date with its own
+ * state, starting by adding itself to it as a changed node.
+ */
+void attach_tracker(Node *node, NodeTracker *tracker)
+{
+    node->tracker = tracker;
+    hold_own_blocks_from(node, 0);
+    link_shared_blocks(node);
+    after_change(node);
+}
+
+void detach_tracker(Node *node)
+{
+    before_change(node);
+    unmark_dirty(node);
+    release_own_blocks_from(node, 0);
+    unlink_shared_blocks(node);
+    node->tracker = NULL;
+}
+
+/* hold_all_blocks: Rebuilds the block holders of tracker, which every node
+ * from head on is attached to. Fails if the index is still incomplete.
+ */
+int hold_all_blocks(NodeTracker *tracker, Node *head)
+{
+    reset_block_holders(&tracker->holders, true);
+    for (; head && tracker->holders.is_complete; head = head->next) {
+        hold_own_blocks_from(head, 0);
+        link_shared_blocks(head);
+    }
+    return tracker->holders.is_complete ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* collect_nodes_holding: Adds to nodes every node tracked by tracker that
+ * holds a block with one of the num_bids ids in bids. The block holders
+ * must be complete.
+ */
+int collect_nodes_holding(const NodeTracker *tracker, const unsigned int *bids, size_t num_bids,
+                          NodeList *nodes)
+{
+    for (size_t i = 0; i < num_bids; i++) {
+        const BlockHolderList *list = get_block_holder_list(&tracker->holders, bids[i]);
+        for (unsigned int j = 0; list && j < list->length; j++) {
+            BlockHolder holder = list->holders[j];
+            if (holder.node) {
+                if (add_to_node_list(nodes, holder.node)) return EXIT_FAILURE;
+                continue;
+            }
+            for (Node *node = holder.shared->sharing_nodes; node; node = node->next_sharing) {
+                if (add_to_node_list(nodes, node)) return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* replace_shared_blocks: Takes over the caller's reference to shared.
+ */
+void replace_shared_blocks(Node *node, SharedBlocks *shared)
+{
+    unlink_shared_blocks(node);
+    release_shared_blocks(node->shared);
+    node->shared = shared;
+    link_shared_blocks(node);
+}
+
+bool is_held(const Node *node)
+{
+    return node->tracker && node->tracker->holders.is_complete;
+}
+
+void hold_own_blocks_from(Node *node, size_t from)
+{
+    if (!is_held(node)) return;
+    BlockHolder holder = {.node = node, .shared = NULL};
+    for (Block *block = get_live_block(&node->blocks, from); block;
+         block = get_live_block(&node->blocks, block - node->blocks.slots + 1)) {
+        hold_block(&node->tracker->holders, block, holder);
+    }
+}
+
+void release_own_blocks_from(Node *node, size_t from)
+{
+    if (!is_held(node)) return;
+    BlockHolder holder = {.node = node, .shared = NULL};
+    for (Block *block = get_live_block(&node->blocks, from); block;
+         block = get_live_block(&node->blocks, block - node->blocks.slots + 1)) {
+        release_block(&node->tracker->holders, block, holder);
+    }
+}
+
+void release_own_block(Node *node, const Block *block)
+{
+    if (!is_held(node)) return;
+    BlockHolder holder = {.node = node, .shared = NULL};
+    release_block(&node->tracker->holders, block, holder);
+}
+
+/* link_shared_blocks: The first node to link shared blocks has them held
+ * on behalf of all the nodes that follow.
+ */
+void link_shared_blocks(Node *node)
+{
+    if (!node->shared || !is_held(node)) return;
+    SharedBlocks *shared = node->shared;
+    BlockHolders *holders = &node->tracker->holders;
+    if (shared->held_generation != holders->generation || !shared->sharing_nodes) {
+        shared->sharing_nodes = NULL;
+        shared->held_generation = holders->generation;
+        BlockHolder holder = {.node = NULL, .shared = shared};
+        for (size_t i = 0; i < shared->blocks.length; i++) {
+            hold_block(holders, &shared->blocks.slots[i], holder);
+        }
+        if (!holders->is_complete) return;
+    }
+    node->prev_sharing = NULL;
+    node->next_sharing = shared->sharing_nodes;
+    if (node->next_sharing) {
+        node->next_sharing->prev_sharing = node;
+    }
+    shared->sharing_nodes = node;
+}
+
+void unlink_shared_blocks(Node *node)
+{
+    if (!node->shared || !is_held(node)) return;
+    SharedBlocks *shared = node->shared;
+    if (node->prev_sharing) {
+        node->prev_sharing->next_sharing = node->next_sharing;
+    } else {
+        shared->sharing_nodes = node->next_sharing;
+    }
+    if (node->next_sharing) {
+        node->next_sharing->prev_sharing = node->prev_sharing;
+    }
+    node->prev_sharing = node->next_sharing = NULL;
+    if (!shared->sharing_nodes) {
+        BlockHolder holder = {.node = NULL, .shared = shared};
+        for (size_t i = 0; i < shared->blocks.length; i++) {
+            release_block(&node->tracker->holders, &shared->blocks.slots[i], holder);
+        }
+    }
+}
+
+Node *pop_dirty_node(NodeTracker *tracker)
+{
+    Node *node = tracker->dirty;
+    if (node) {
+        unmark_dirty(node);
+    }
+    return node;
+}
+
+void before_change(const Node *node)
+{
+    if (!node->tracker) return;
+    node->tracker->num_empty -= node_is_empty(node);
+    node->tracker->num_unsynced -= !node_is_synced(node);
+    node->tracker->num_with_synced_blocks -= node->sync_length > 0;
+}
+
+void after_change(Node *node)
+{
+    node->is_unsaved = true;
+    if (!node->tracker) return;
+    node->tracker->num_empty += node_is_empty(node);
+    node->tracker->num_unsynced += !node_is_synced(node);
+    node->tracker->num_with_synced_blocks += node->sync_length > 0;
+    mark_dirty(node);
+}
+
+void mark_dirty(Node *node)
+{
+    if (node->is_dirty) return;
+    node->is_dirty = true;
+    node->prev_dirty = NULL;
+    node->next_dirty = node->tracker->dirty;
+    if (node->next_dirty) {
+        node->next_dirty->prev_dirty = node;
+    }
+    node->tracker->dirty = node;
+}
+
+void unmark_dirty(Node *node)
+{
+    if (!node->is_dirty) return;
+    node->is_dirty = false;
+    if (node->prev_dirty) {
+        node->prev_dirty->next_dirty = node->next_dirty;
+    } else {
+        node->tracker->dirty = node->next_dirty;
+    }
+    if (node->next_dirty) {
+        node->next_dirty->prev_dirty = node->prev_dirty;
+    }
+    node->prev_dirty = node->next_dirty = NULL;
 }
 
 bool node_is_empty(const Node *node)
 {
-    return !node->head;
+    return !get_length(node);
 }
 
-bool node_has_one_block(const Node *node)
+/* free_node_blocks: Frees what node holds, but not node itself, which goes
+ * back to its blockchain's pool.
+ */
+void free_node_blocks(Node *node)
 {
-    return node->head == node->tail;
+    release_shared_blocks(node->shared);
+    free_block_array(&node->blocks);
 }
 
-void free_node(Node *node)
+NodeList create_node_list()
 {
-    free_chain(node->head);
-    free(node);
+    NodeList list = {
+            .nodes = NULL,
+            .length = 0,
+            .capacity = 0,
+            .ids = create_uint_index_of(MEM_SCRATCH)
+    };
+    return list;
 }
 
-void free_node_chain(Node *head)
+/* add_to_node_list: Does nothing if node is already in list.
+ */
+int add_to_node_list(NodeList *list, Node *node)
 {
-    while (head) {
-        Node *current = head;
-        head = current->next;
-        free_node(current);
+    if (uint_index_get(&list->ids, node->id) != UINT_INDEX_NONE) return EXIT_SUCCESS;
+    if (list->length == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 8;
+        Node **nodes = mem_realloc(MEM_SCRATCH, list->nodes, list->capacity * sizeof (Node *),
+                                   capacity * sizeof (Node *));
+        if (!nodes) return EXIT_FAILURE;
+        list->nodes = nodes;
+        list->capacity = capacity;
     }
+    if (uint_index_put(&list->ids, node->id, list->length)) return EXIT_FAILURE;
+    list->nodes[list->length++] = node;
+    return EXIT_SUCCESS;
+}
+
+void free_node_list(NodeList *list)
+{
+    mem_free(MEM_SCRATCH, list->nodes, list->capacity * sizeof (Node *));
+    free_uint_index(&list->ids);
+    *list = create_node_list();
 }
@@ -4,13 +4,44 @@
 #include "node_public.h"
 #include <stdbool.h>
 
-Node create_node(unsigned int nid);
-Block *get_post_sync_chain(const Node *node);
-void add_chain(Block *head, Node *node);
+/* One removal of a set of block ids from many nodes. The ids are kept both
+ * as a list, with room for max_ids, and as a set, so that each node can
+ * either look them up or sweep its blocks, whichever is shorter. shared is
+ * the last shared sequence a node removed blocks from, and derived what is
+ * left of it, so that nodes sharing it all switch to the same sequence.
+ */
+typedef struct s_block_removal {
+    unsigned int *ids;
+    size_t num_ids;
+    size_t max_ids;
+    UintIndex id_set;
+    SharedBlocks *shared;
+    SharedBlocks *derived;
+} BlockRemoval;
+
+void init_node(Node *node, unsigned int nid);
+size_t get_block_position(const Node *node, const Block *block);
+Block *get_first_post_sync_block(const Node *node);
+int rmv_post_sync_blocks(Node *node);
+int add_blocks(const Block *blocks, size_t num_blocks, Node *node);
+SharedBlocks *new_synced_blocks(const Node *node, const Block *blocks, size_t num_blocks);
+void set_shared_blocks(Node *node, SharedBlocks *shared);
+void clear_node(Node *node);
+void set_own_blocks(Node *node, BlockArray *blocks);
+bool node_has_same_blocks(const Node *node, const Node *other);
+int create_block_removal(BlockRemoval *removal, const unsigned int *bids, size_t num_bids);
+int rmv_blocks(BlockRemoval *removal, Node *node, size_t *num_removed);
+void free_block_removal(BlockRemoval *removal);
 bool node_is_synced(const Node *node);
 void declare_node_synced(Node *node);
+void set_sync_length(Node *node, size_t sync_length);
+void attach_tracker(Node *node, NodeTracker *tracker);
+void detach_tracker(Node *node);
+int hold_all_blocks(NodeTracker *tracker, Node *head);
+int collect_nodes_holding(const NodeTracker *tracker, const unsigned int *bids, size_t num_bids,
+                          NodeList *nodes);
+Node *pop_dirty_node(NodeTracker *tracker);
 bool node_is_empty(const Node *node);
-void free_node(Node *node);
-void free_node_chain(Node *node);
+void free_node_blocks(Node *node);
 
 #endif
@@ -2,21 +2,71 @@
 #define NODE_PUBLIC_H
 
 #include "block/block_public.h"
+#include "block_holders.h"
 #include <stdbool.h>
 
+struct s_node;
+
+/* Kept up to date by every node attached to it, so that the blockchain
+ * knows its sync state without looking at all of its nodes: how many nodes
+ * are empty, how many are not synced, how many have synced blocks at all,
+ * which nodes changed since the last update_sync_state(), and which nodes
+ * hold each block.
+ */
+typedef struct s_node_tracker {
+    size_t num_empty;
+    size_t num_unsynced;
+    size_t num_with_synced_blocks;
+    struct s_node *dirty;
+    BlockHolders holders;
+} NodeTracker;
+
+/* A node's blocks are the shared blocks, if any, followed by the live slots
+ * of its own blocks. Nodes synchronized together share one read-only copy
+ * of their blocks, until one of them is changed. The first sync_length
+ * positions are synchronized with the other nodes; the blocks after them
+ * were added since. tallied_next_id is the first of those later blocks as
+ * of the last update_sync_state(), if next_is_tallied. prev_sharing and
+ * next_sharing link the tracked nodes sharing the same blocks. is_unsaved
+ * is set by every change, until the blockchain is next saved.
+ */
 typedef struct s_node {
     unsigned int id;
-    Block *head;
-    Block *sync_tail;
-    Block *tail;
+    SharedBlocks *shared;
+    struct s_node *prev_sharing;
+    struct s_node *next_sharing;
+    BlockArray blocks;
+    size_t sync_length;
+    NodeTracker *tracker;
+    bool is_dirty;
+    struct s_node *prev_dirty;
+    struct s_node *next_dirty;
+    bool is_unsaved;
+    bool next_is_tallied;
+    unsigned int tallied_next_id;
     struct s_node *prev;
     struct s_node *next;
 } Node;
 
-Node *new_node(unsigned int nid);
-bool has_block_with_id(unsigned int bid, Node *node);
-Block *get_block_from_id(unsigned int bid, Node *node);
-void add_block(Block *block, Node *node);
-void rmv_block(Block *block, Node *node);
+/* A growable list of distinct nodes, accounted as scratch memory.
+ */
+typedef struct s_node_list {
+    struct s_node **nodes;
+    size_t length;
+    size_t capacity;
+    UintIndex ids;
+} NodeList;
+
+bool has_block_with_id(unsigned int bid, const Node *node);
+Block *get_block_from_id(unsigned int bid, const Node *node);
+Block *first_block(const Node *node);
+Block *next_block(const Node *node, const Block *block);
+size_t get_num_blocks(const Node *node);
+int add_block(unsigned int bid, Node *node);
+int rmv_block(Block *block, Node *node);
+
+NodeList create_node_list();
+int add_to_node_list(NodeList *list, Node *node);
+void free_node_list(NodeList *list);
 
 #endif
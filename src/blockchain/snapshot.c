@@ -0,0 +1,609 @@
+/* snapshot.c: Binary snapshots of the blockchain, which load without any
+ * parsing. All integers are little-endian:
+ *
+ *     header     "MYBC", version, num_segments, num_nodes (u32 each),
+ *                num_ids, lineage, sequence (u64 each),
+ *                num_removed, flags (u32 each)
+ *     segments   num_segments x {offset (u64), length, reserved (u32 each)}
+ *     nodes      num_nodes x {id, segment, num_blocks, reserved (u32 each),
+ *                offset, sync_length (u64 each)}
+ *     removed    num_removed x node id (u32)
+ *     ids        num_ids x block id (u32)
+ *
+ * A segment is a sequence of blocks shared by nodes, written once however
+ * many nodes share it. A node's blocks are those of its segment, unless
+ * segment is NO_SEGMENT, followed by its own num_blocks blocks. Offsets
+ * count ids from the first one. sync_length is the node's sync boundary,
+ * so that loading a snapshot restores the sync state as it was saved.
+ *
+ * A snapshot flagged SNAPSHOT_DELTA holds only the nodes changed since the
+ * snapshot before it, and the ids of the nodes removed since. Snapshots
+ * that build on one another share a lineage, and are numbered in order by
+ * sequence (see checkpoint.c). Version 1 snapshots, whose header ends
+ * after num_ids, are still read, as full snapshots of lineage 0.
+ */
+
+#include "snapshot.h"
+#include "blockchain_private.h"
+#include "node/node_private.h"
+#include "node/block/block_private.h"
+#include "../utils/uint_index.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC "MYBC"
+#define SNAPSHOT_VERSION 2
+#define V1_HEADER_SIZE 32
+#define HEADER_SIZE 48
+#define SEGMENT_ENTRY_SIZE 16
+#define NODE_ENTRY_SIZE 32
+#define NO_SEGMENT UINT32_MAX
+#define SNAPSHOT_DELTA 1u
+
+/* Where the tables of a snapshot start, once its header and every table
+ * entry have been checked against its size.
+ */
+typedef struct s_snapshot_layout {
+    SnapshotInfo info;
+    uint32_t num_segments;
+    uint32_t num_nodes;
+    uint32_t num_removed;
+    uint64_t num_ids;
+    const unsigned char *segments;
+    const unsigned char *nodes;
+    const unsigned char *removed;
+    const unsigned char *ids;
+} SnapshotLayout;
+
+/* The distinct shared blocks of the nodes written, sorted by address so
+ * that a node's segment can be found by binary search.
+ */
+typedef struct s_segments {
+    const void **shared;
+    size_t length;
+} Segments;
+
+/* A node of a merged snapshot, pointing into the snapshot that last
+ * changed it.
+ */
+typedef struct s_merged_node {
+    uint32_t id;
+    const unsigned char *segment;
+    uint32_t segment_length;
+    const unsigned char *ids;
+    uint32_t num_blocks;
+    uint64_t sync_length;
+    bool is_removed;
+} MergedNode;
+
+typedef struct s_merge {
+    MergedNode *nodes;
+    size_t length;
+    size_t capacity;
+    UintIndex positions;
+} Merge;
+
+static int is_written(const Node *node, const SnapshotInfo *info);
+static int collect_segments(const Blockchain *chain, const SnapshotInfo *info, Segments *segments);
+static void sort_segments(Segments *segments);
+static int compare_addresses(const void *shared, const void *other);
+static uint32_t find_segment(const Segments *segments, const void *shared);
+static void write_header(Writer *writer, const SnapshotInfo *info, size_t num_segments,
+                         size_t num_nodes, uint64_t num_ids, size_t num_removed);
+static void write_tables(Writer *writer, const Blockchain *chain, const SnapshotInfo *info,
+                         const Segments *segments, const UintIndex *removed);
+static uint64_t get_num_synced_blocks(const Node *node);
+static void write_ids(Writer *writer, const Blockchain *chain, const SnapshotInfo *info,
+                      const Segments *segments);
+static void write_u32(Writer *writer, uint32_t value);
+static void write_u64(Writer *writer, uint64_t value);
+static int read_layout(const unsigned char *data, size_t size, SnapshotLayout *layout);
+static int check_entries(const SnapshotLayout *layout);
+static int load_segments(const SnapshotLayout *layout, SharedBlocks **segments);
+static int prepare_nodes(Blockchain *chain, const SnapshotLayout *layout);
+static int fill_nodes(Blockchain *chain, const SnapshotLayout *layout, SharedBlocks **segments);
+static int fill_node(Node *node, const unsigned char *entry, const SnapshotLayout *layout,
+                     SharedBlocks **segments);
+static void rmv_all_nodes(Blockchain *chain);
+static int merge_snapshot(Merge *merge, const SnapshotLayout *layout);
+static int write_merge(Writer *writer, const Merge *merge, const SnapshotInfo *info);
+static uint32_t read_u32(const unsigned char *bytes);
+static uint64_t read_u64(const unsigned char *bytes);
+
+bool is_snapshot(const unsigned char *data, size_t size)
+{
+    return size >= V1_HEADER_SIZE && !memcmp(data, SNAPSHOT_MAGIC, 4);
+}
+
+int read_snapshot_info(const unsigned char *data, size_t size, SnapshotInfo *info)
+{
+    SnapshotLayout layout;
+    if (read_layout(data, size, &layout)) return EXIT_FAILURE;
+    *info = layout.info;
+    return EXIT_SUCCESS;
+}
+
+/* write_snapshot: Writes every node, or, for a delta, the unsaved nodes
+ * and the ids of the nodes removed since the blockchain was last saved.
+ * Leaves the snapshot in writer's buffer, to be flushed by the caller.
+ */
+int write_snapshot(Writer *writer, const Blockchain *chain, const SnapshotInfo *info)
+{
+    const UintIndex *removed = NULL;
+    if (info->is_delta && !(removed = get_unsaved_removals(chain))) return EXIT_FAILURE;
+    Segments segments;
+    if (collect_segments(chain, info, &segments)) return EXIT_FAILURE;
+    write_tables(writer, chain, info, &segments, removed);
+    write_ids(writer, chain, info, &segments);
+    free(segments.shared);
+    return writer->status;
+}
+
+int is_written(const Node *node, const SnapshotInfo *info)
+{
+    return !info->is_delta || node->is_unsaved;
+}
+
+int collect_segments(const Blockchain *chain, const SnapshotInfo *info, Segments *segments)
+{
+    segments->shared = malloc((get_num_nodes(chain) + 1) * sizeof (void *));
+    segments->length = 0;
+    if (!segments->shared) return EXIT_FAILURE;
+    for (Node *node = get_nodes(chain); node; node = node->next) {
+        if (node->shared && is_written(node, info)) {
+            segments->shared[segments->length++] = node->shared;
+        }
+    }
+    sort_segments(segments);
+    return EXIT_SUCCESS;
+}
+
+/* sort_segments: Sorts, then drops duplicates.
+ */
+void sort_segments(Segments *segments)
+{
+    qsort(segments->shared, segments->length, sizeof (void *), compare_addresses);
+    size_t length = 0;
+    for (size_t i = 0; i < segments->length; i++) {
+        if (!length || segments->shared[length - 1] != segments->shared[i]) {
+            segments->shared[length++] = segments->shared[i];
+        }
+    }
+    segments->length = length;
+}
+
+int compare_addresses(const void *shared, const void *other)
+{
+    uintptr_t address = (uintptr_t) *(const void * const *) shared;
+    uintptr_t other_address = (uintptr_t) *(const void * const *) other;
+    return (address > other_address) - (address < other_address);
+}
+
+uint32_t find_segment(const Segments *segments, const void *shared)
+{
+    if (!shared) return NO_SEGMENT;
+    const void **found = bsearch(&shared, segments->shared, segments->length,
+                                 sizeof (void *), compare_addresses);
+    return found - segments->shared;
+}
+
+void write_header(Writer *writer, const SnapshotInfo *info, size_t num_segments,
+                  size_t num_nodes, uint64_t num_ids, size_t num_removed)
+{
+    write_bytes(writer, SNAPSHOT_MAGIC, 4);
+    write_u32(writer, SNAPSHOT_VERSION);
+    write_u32(writer, num_segments);
+    write_u32(writer, num_nodes);
+    write_u64(writer, num_ids);
+    write_u64(writer, info->lineage);
+    write_u64(writer, info->sequence);
+    write_u32(writer, num_removed);
+    write_u32(writer, info->is_delta ? SNAPSHOT_DELTA : 0);
+}
+
+void write_tables(Writer *writer, const Blockchain *chain, const SnapshotInfo *info,
+                  const Segments *segments, const UintIndex *removed)
+{
+    uint64_t num_ids = 0;
+    size_t num_nodes = 0;
+    for (size_t i = 0; i < segments->length; i++) {
+        num_ids += ((const SharedBlocks *) segments->shared[i])->blocks.length;
+    }
+    for (Node *node = get_nodes(chain); node; node = node->next) {
+        if (!is_written(node, info)) continue;
+        num_ids += get_num_live_blocks(&node->blocks);
+        num_nodes++;
+    }
+    write_header(writer, info, segments->length, num_nodes, num_ids,
+                 removed ? removed->size : 0);
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < segments->length; i++) {
+        size_t length = ((const SharedBlocks *) segments->shared[i])->blocks.length;
+        write_u64(writer, offset);
+        write_u32(writer, length);
+        write_u32(writer, 0);
+        offset += length;
+    }
+    for (Node *node = get_nodes(chain); node; node = node->next) {
+        if (!is_written(node, info)) continue;
+        size_t num_blocks = get_num_live_blocks(&node->blocks);
+        write_u32(writer, node->id);
+        write_u32(writer, find_segment(segments, node->shared));
+        write_u32(writer, num_blocks);
+        write_u32(writer, 0);
+        write_u64(writer, offset);
+        write_u64(writer, get_num_synced_blocks(node));
+        offset += num_blocks;
+    }
+    for (size_t i = 0; removed && i < removed->capacity; i++) {
+        if (removed->slots[i].value != UINT_INDEX_NONE) {
+            write_u32(writer, removed->slots[i].key);
+        }
+    }
+}
+
+/* get_num_synced_blocks: A node's sync length counts the removed blocks
+ * still stored before its boundary, which snapshots leave out.
+ */
+uint64_t get_num_synced_blocks(const Node *node)
+{
+    size_t shared_length = node->shared ? node->shared->blocks.length : 0;
+    if (node->sync_length <= shared_length) {
+        return node->sync_length;
+    }
+    uint64_t num_synced = 0;
+    for (Block *block = first_block(node);
+         block && get_block_position(node, block) < node->sync_length;
+         block = next_block(node, block)) {
+        num_synced++;
+    }
+    return num_synced;
+}
+
+void write_ids(Writer *writer, const Blockchain *chain, const SnapshotInfo *info,
+               const Segments *segments)
+{
+    for (size_t i = 0; i < segments->length; i++) {
+        const BlockArray *blocks = &((const SharedBlocks *) segments->shared[i])->blocks;
+        for (size_t j = 0; j < blocks->length; j++) {
+            write_u32(writer, blocks->slots[j].id);
+        }
+    }
+    for (Node *node = get_nodes(chain); node; node = node->next) {
+        if (!is_written(node, info)) continue;
+        const BlockArray *blocks = &node->blocks;
+        for (Block *block = get_live_block(blocks, 0); block;
+             block = get_live_block(blocks, block - blocks->slots + 1)) {
+            write_u32(writer, block->id);
+        }
+    }
+}
+
+void write_u32(Writer *writer, uint32_t value)
+{
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = value >> (8 * i);
+    }
+    write_bytes(writer, bytes, 4);
+}
+
+void write_u64(Writer *writer, uint64_t value)
+{
+    write_u32(writer, value);
+    write_u32(writer, value >> 32);
+}
+
+/* read_snapshot: Builds the blockchain from a full snapshot, or applies a
+ * delta to it, data being the whole snapshot. The blockchain must be empty
+ * or, for a delta, saved. Snapshots are checked before anything is
+ * changed: only a snapshot that is well formed but inconsistent, such as
+ * one listing a block twice in a node, fails midway, in which case no
+ * node is left. Leaves the blockchain saved.
+ */
+int read_snapshot(Blockchain *chain, const unsigned char *data, size_t size)
+{
+    SnapshotLayout layout;
+    if (read_layout(data, size, &layout)) return EXIT_FAILURE;
+    SharedBlocks **segments = calloc(layout.num_segments + 1, sizeof (SharedBlocks *));
+    if (!segments) return EXIT_FAILURE;
+    int status = load_segments(&layout, segments)
+                 || prepare_nodes(chain, &layout)
+                 || fill_nodes(chain, &layout, segments);
+    for (uint32_t i = 0; i < layout.num_segments; i++) {
+        release_shared_blocks(segments[i]);
+    }
+    free(segments);
+    if (status) {
+        rmv_all_nodes(chain);
+        declare_blockchain_saved(chain);
+        return EXIT_FAILURE;
+    }
+    update_sync_state(chain);
+    declare_blockchain_saved(chain);
+    return EXIT_SUCCESS;
+}
+
+int read_layout(const unsigned char *data, size_t size, SnapshotLayout *layout)
+{
+    if (!is_snapshot(data, size)) return EXIT_FAILURE;
+    uint32_t version = read_u32(data + 4);
+    size_t header_size = version == 1 ? V1_HEADER_SIZE : HEADER_SIZE;
+    if ((version != 1 && version != SNAPSHOT_VERSION) || size < header_size) {
+        return EXIT_FAILURE;
+    }
+    layout->num_segments = read_u32(data + 8);
+    layout->num_nodes = read_u32(data + 12);
+    layout->num_ids = read_u64(data + 16);
+    layout->info.lineage = version == 1 ? 0 : read_u64(data + 24);
+    layout->info.sequence = version == 1 ? 0 : read_u64(data + 32);
+    layout->num_removed = version == 1 ? 0 : read_u32(data + 40);
+    layout->info.is_delta = version == 1 ? false : read_u32(data + 44) & SNAPSHOT_DELTA;
+    if (layout->num_removed && !layout->info.is_delta) return EXIT_FAILURE;
+    uint64_t tables_size = header_size
+                           + (uint64_t) layout->num_segments * SEGMENT_ENTRY_SIZE
+                           + (uint64_t) layout->num_nodes * NODE_ENTRY_SIZE
+                           + (uint64_t) layout->num_removed * 4;
+    if (tables_size > size || layout->num_ids != (size - tables_size) / 4
+            || (size - tables_size) % 4) {
+        return EXIT_FAILURE;
+    }
+    layout->segments = data + header_size;
+    layout->nodes = layout->segments + (size_t) layout->num_segments * SEGMENT_ENTRY_SIZE;
+    layout->removed = layout->nodes + (size_t) layout->num_nodes * NODE_ENTRY_SIZE;
+    layout->ids = layout->removed + (size_t) layout->num_removed * 4;
+    return check_entries(layout);
+}
+
+int check_entries(const SnapshotLayout *layout)
+{
+    const unsigned char *entry = layout->segments;
+    for (uint32_t i = 0; i < layout->num_segments; i++, entry += SEGMENT_ENTRY_SIZE) {
+        uint64_t offset = read_u64(entry);
+        uint32_t length = read_u32(entry + 8);
+        if (!length || offset > layout->num_ids || length > layout->num_ids - offset) {
+            return EXIT_FAILURE;
+        }
+    }
+    entry = layout->nodes;
+    for (uint32_t i = 0; i < layout->num_nodes; i++, entry += NODE_ENTRY_SIZE) {
+        uint32_t segment = read_u32(entry + 4);
+        uint32_t num_blocks = read_u32(entry + 8);
+        uint64_t offset = read_u64(entry + 16);
+        if ((segment != NO_SEGMENT && segment >= layout->num_segments)
+                || offset > layout->num_ids || num_blocks > layout->num_ids - offset) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int load_segments(const SnapshotLayout *layout, SharedBlocks **segments)
+{
+    const unsigned char *entry = layout->segments;
+    for (uint32_t i = 0; i < layout->num_segments; i++, entry += SEGMENT_ENTRY_SIZE) {
+        uint64_t offset = read_u64(entry);
+        uint32_t length = read_u32(entry + 8);
+        segments[i] = new_shared_blocks();
+        if (!segments[i]) return EXIT_FAILURE;
+        BlockArray *blocks = &segments[i]->blocks;
+        for (uint32_t j = 0; j < length; j++) {
+            unsigned int bid = read_u32(layout->ids + 4 * (offset + j));
+            if (get_block(blocks, bid) || append_block(blocks, bid)) return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* prepare_nodes: Removes the removed nodes, empties the saved nodes that
+ * the snapshot replaces and adds its new nodes, empty, as adding a node to
+ * nodes with synced blocks would reset their sync boundaries. A node that
+ * is already unsaved is listed twice.
+ */
+int prepare_nodes(Blockchain *chain, const SnapshotLayout *layout)
+{
+    for (uint32_t i = 0; i < layout->num_removed; i++) {
+        Node *node = get_node_from_id(chain, read_u32(layout->removed + 4 * i));
+        if (node) {
+            rmv_node(chain, node);
+        }
+    }
+    const unsigned char *entry = layout->nodes;
+    for (uint32_t i = 0; i < layout->num_nodes; i++, entry += NODE_ENTRY_SIZE) {
+        unsigned int nid = read_u32(entry);
+        Node *node = get_node_from_id(chain, nid);
+        if (node && node->is_unsaved) return EXIT_FAILURE;
+        if (node) {
+            clear_node(node);
+            continue;
+        }
+        if (!(node = new_node(chain, nid))) return EXIT_FAILURE;
+        if (add_node(chain, node)) {
+            free_node(chain, node);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int fill_nodes(Blockchain *chain, const SnapshotLayout *layout, SharedBlocks **segments)
+{
+    const unsigned char *entry = layout->nodes;
+    for (uint32_t i = 0; i < layout->num_nodes; i++, entry += NODE_ENTRY_SIZE) {
+        Node *node = get_node_from_id(chain, read_u32(entry));
+        if (fill_node(node, entry, layout, segments)) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int fill_node(Node *node, const unsigned char *entry, const SnapshotLayout *layout,
+              SharedBlocks **segments)
+{
+    uint32_t segment = read_u32(entry + 4);
+    uint32_t num_blocks = read_u32(entry + 8);
+    uint64_t offset = read_u64(entry + 16);
+    uint64_t sync_length = read_u64(entry + 24);
+    if (segment != NO_SEGMENT) {
+        set_shared_blocks(node, segments[segment]);
+    }
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        unsigned int bid = read_u32(layout->ids + 4 * (offset + i));
+        if (has_block_with_id(bid, node) || add_block(bid, node)) return EXIT_FAILURE;
+    }
+    if (sync_length > get_num_blocks(node)) return EXIT_FAILURE;
+    set_sync_length(node, sync_length);
+    return EXIT_SUCCESS;
+}
+
+void rmv_all_nodes(Blockchain *chain)
+{
+    while (get_nodes(chain)) {
+        rmv_node(chain, get_nodes(chain));
+    }
+}
+
+/* merge_snapshots: Writes the full snapshot that reading all of the given
+ * snapshots in order would build: a full one, then deltas. Works on the
+ * files alone, without the blockchain, ids being copied as they are.
+ */
+int merge_snapshots(Writer *writer, const unsigned char *const *data, const size_t *sizes,
+                    size_t num_snapshots, const SnapshotInfo *info)
+{
+    Merge merge = {
+            .nodes = NULL,
+            .length = 0,
+            .capacity = 0,
+            .positions = create_uint_index()
+    };
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; !status && i < num_snapshots; i++) {
+        SnapshotLayout layout;
+        status = read_layout(data[i], sizes[i], &layout)
+                 || merge_snapshot(&merge, &layout);
+    }
+    if (!status) {
+        status = write_merge(writer, &merge, info);
+    }
+    free(merge.nodes);
+    free_uint_index(&merge.positions);
+    return status;
+}
+
+int merge_snapshot(Merge *merge, const SnapshotLayout *layout)
+{
+    for (uint32_t i = 0; i < layout->num_removed; i++) {
+        unsigned int position = uint_index_remove(&merge->positions,
+                                                  read_u32(layout->removed + 4 * i));
+        if (position != UINT_INDEX_NONE) {
+            merge->nodes[position].is_removed = true;
+        }
+    }
+    const unsigned char *entry = layout->nodes;
+    for (uint32_t i = 0; i < layout->num_nodes; i++, entry += NODE_ENTRY_SIZE) {
+        uint32_t id = read_u32(entry);
+        unsigned int position = uint_index_get(&merge->positions, id);
+        if (position == UINT_INDEX_NONE) {
+            if (merge->length == merge->capacity) {
+                size_t capacity = merge->capacity ? 2 * merge->capacity : 64;
+                MergedNode *nodes = realloc(merge->nodes, capacity * sizeof (MergedNode));
+                if (!nodes) return EXIT_FAILURE;
+                merge->nodes = nodes;
+                merge->capacity = capacity;
+            }
+            position = merge->length++;
+            if (uint_index_put(&merge->positions, id, position)) return EXIT_FAILURE;
+        }
+        MergedNode *node = &merge->nodes[position];
+        uint32_t segment = read_u32(entry + 4);
+        node->id = id;
+        node->segment = NULL;
+        node->segment_length = 0;
+        if (segment != NO_SEGMENT) {
+            const unsigned char *segment_entry = layout->segments + segment * SEGMENT_ENTRY_SIZE;
+            node->segment = layout->ids + 4 * read_u64(segment_entry);
+            node->segment_length = read_u32(segment_entry + 8);
+        }
+        node->num_blocks = read_u32(entry + 8);
+        node->ids = layout->ids + 4 * read_u64(entry + 16);
+        node->sync_length = read_u64(entry + 24);
+        node->is_removed = false;
+    }
+    return EXIT_SUCCESS;
+}
+
+int write_merge(Writer *writer, const Merge *merge, const SnapshotInfo *info)
+{
+    Segments segments = {.shared = malloc((merge->length + 1) * sizeof (void *)), .length = 0};
+    if (!segments.shared) return EXIT_FAILURE;
+    uint64_t num_ids = 0;
+    size_t num_nodes = 0;
+    for (size_t i = 0; i < merge->length; i++) {
+        const MergedNode *node = &merge->nodes[i];
+        if (node->is_removed) continue;
+        if (node->segment) {
+            segments.shared[segments.length++] = node->segment;
+        }
+        num_ids += node->num_blocks;
+        num_nodes++;
+    }
+    sort_segments(&segments);
+    size_t *segment_lengths = malloc((segments.length + 1) * sizeof (size_t));
+    if (!segment_lengths) {
+        free(segments.shared);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < merge->length; i++) {
+        const MergedNode *node = &merge->nodes[i];
+        if (!node->is_removed && node->segment) {
+            segment_lengths[find_segment(&segments, node->segment)] = node->segment_length;
+        }
+    }
+    for (size_t i = 0; i < segments.length; i++) {
+        num_ids += segment_lengths[i];
+    }
+    write_header(writer, info, segments.length, num_nodes, num_ids, 0);
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < segments.length; i++) {
+        write_u64(writer, offset);
+        write_u32(writer, segment_lengths[i]);
+        write_u32(writer, 0);
+        offset += segment_lengths[i];
+    }
+    for (size_t i = 0; i < merge->length; i++) {
+        const MergedNode *node = &merge->nodes[i];
+        if (node->is_removed) continue;
+        write_u32(writer, node->id);
+        write_u32(writer, find_segment(&segments, node->segment));
+        write_u32(writer, node->num_blocks);
+        write_u32(writer, 0);
+        write_u64(writer, offset);
+        write_u64(writer, node->sync_length);
+        offset += node->num_blocks;
+    }
+    for (size_t i = 0; i < segments.length; i++) {
+        write_bytes(writer, segments.shared[i], 4 * segment_lengths[i]);
+    }
+    for (size_t i = 0; i < merge->length; i++) {
+        const MergedNode *node = &merge->nodes[i];
+        if (!node->is_removed) {
+            write_bytes(writer, node->ids, 4 * node->num_blocks);
+        }
+    }
+    free(segment_lengths);
+    free(segments.shared);
+    return writer->status;
+}
+
+uint32_t read_u32(const unsigned char *bytes)
+{
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8
+           | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+uint64_t read_u64(const unsigned char *bytes)
+{
+    return read_u32(bytes) | (uint64_t) read_u32(bytes + 4) << 32;
+}
@@ -0,0 +1,26 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "blockchain_public.h"
+#include "../utils/writer.h"
+
+/* Where a snapshot stands: the full snapshot that started its lineage has
+ * sequence 0, and each delta on top of it the next sequence.
+ */
+typedef struct s_snapshot_info {
+    unsigned long lineage;
+    unsigned long sequence;
+    bool is_delta;
+} SnapshotInfo;
+
+bool is_snapshot(const unsigned char *data, size_t size);
+int read_snapshot_info(const unsigned char *data, size_t size, SnapshotInfo *info);
+int write_snapshot(Writer *writer, const Blockchain *chain, const SnapshotInfo *info);
+int read_snapshot(Blockchain *chain, const unsigned char *data, size_t size);
+int merge_snapshots(Writer *writer, const unsigned char *const *data, const size_t *sizes,
+                    size_t num_snapshots, const SnapshotInfo *info);
+
+#endif
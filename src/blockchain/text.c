@@ -0,0 +1,216 @@
+/* text.c: Reads the text save format, one node per line:
+ *
+ *     nid:bid,bid,...
+ *
+ * The file is split into ranges of whole lines, parsed at once on as many
+ * threads as there are cores, up to one per MIN_RANGE_SIZE bytes. Each
+ * thread parses its range into a batch of nodes that are not yet part of
+ * the blockchain; the calling thread then adds the batches in file order,
+ * so that the result is the same as parsing line by line.
+ *
+ * Ids are read as strtol() would, up to the first character that is not a
+ * digit, and wrap around past UINT_MAX. Repeated separators count as one,
+ * except right after the nid, where an empty block id reads as 0. Reading
+ * stops at the first line that is empty, repeats a block of its node or
+ * repeats a node: the nodes before it are kept, and it fails.
+ */
+
+#include "text.h"
+#include "blockchain_private.h"
+#include "node/node_private.h"
+#include "node/block/block_private.h"
+#include "../utils/thread_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIN_RANGE_SIZE (1 << 20)
+#define MAX_LOAD_THREADS 64
+#define MIN_BATCH_CAPACITY 64
+
+/* A line parsed into the blocks of a node to be.
+ */
+typedef struct s_parsed_node {
+    unsigned int id;
+    BlockArray blocks;
+} ParsedNode;
+
+/* One thread's share of the file, and the nodes parsed from it. status is
+ * set if the line after the last node failed to parse.
+ */
+typedef struct s_text_range {
+    const char *start;
+    const char *end;
+    ParsedNode *batch;
+    size_t length;
+    size_t capacity;
+    int status;
+} TextRange;
+
+static size_t get_num_load_threads(size_t size);
+static void split_ranges(const char *data, size_t size, TextRange *ranges, size_t num_ranges);
+static void parse_range(void *arg, size_t worker);
+static int parse_line(const char *line, const char *line_end, ParsedNode *parsed);
+static unsigned int parse_id(const char *token, const char *token_end);
+static int add_batches(Blockchain *chain, TextRange *ranges, size_t num_ranges);
+static void free_batches(TextRange *ranges, size_t num_ranges);
+
+/* read_text: Adds the nodes of the text data to the blockchain.
+ */
+int read_text(Blockchain *chain, const char *data, size_t size)
+{
+    ThreadPool pool;
+    create_thread_pool(&pool, get_num_load_threads(size));
+    // Fewer threads than asked for may have started.
+    size_t num_ranges = pool.num_workers;
+    TextRange *ranges = calloc(num_ranges, sizeof (TextRange));
+    if (!ranges) {
+        free_thread_pool(&pool);
+        return EXIT_FAILURE;
+    }
+    split_ranges(data, size, ranges, num_ranges);
+    run_on_thread_pool(&pool, parse_range, ranges);
+    free_thread_pool(&pool);
+    int status = add_batches(chain, ranges, num_ranges);
+    free_batches(ranges, num_ranges);
+    free(ranges);
+    if (!status) {
+        update_sync_state(chain);
+    }
+    return status;
+}
+
+size_t get_num_load_threads(size_t size)
+{
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = size / MIN_RANGE_SIZE;
+    if (num_cores > 0 && num_threads > (size_t) num_cores) {
+        num_threads = num_cores;
+    }
+    if (num_threads > MAX_LOAD_THREADS) {
+        num_threads = MAX_LOAD_THREADS;
+    }
+    return num_threads ? num_threads : 1;
+}
+
+/* split_ranges: Cuts data into ranges of about the same size, each moved
+ * forward to the start of a line. Ranges may be empty.
+ */
+void split_ranges(const char *data, size_t size, TextRange *ranges, size_t num_ranges)
+{
+    const char *end = data + size;
+    const char *start = data;
+    for (size_t i = 0; i < num_ranges; i++) {
+        const char *range_end = end;
+        const char *target = data + size / num_ranges * (i + 1);
+        if (i + 1 < num_ranges && target <= start) {
+            range_end = start;
+        } else if (i + 1 < num_ranges) {
+            const char *newline = memchr(target - 1, '\n', end - target + 1);
+            range_end = newline ? newline + 1 : end;
+        }
+        ranges[i].start = start;
+        ranges[i].end = range_end;
+        start = range_end;
+    }
+}
+
+void parse_range(void *arg, size_t worker)
+{
+    TextRange *range = (TextRange *) arg + worker;
+    const char *line = range->start;
+    while (line < range->end) {
+        const char *newline = memchr(line, '\n', range->end - line);
+        const char *line_end = newline ? newline : range->end;
+        if (range->length == range->capacity) {
+            size_t capacity = range->capacity ? 2 * range->capacity : MIN_BATCH_CAPACITY;
+            ParsedNode *batch = realloc(range->batch, capacity * sizeof (ParsedNode));
+            if (!batch) {
+                range->status = EXIT_FAILURE;
+                return;
+            }
+            range->batch = batch;
+            range->capacity = capacity;
+        }
+        ParsedNode *parsed = &range->batch[range->length];
+        if (parse_line(line, line_end, parsed)) {
+            free_block_array(&parsed->blocks);
+            range->status = EXIT_FAILURE;
+            return;
+        }
+        range->length++;
+        line = line_end + 1;
+    }
+}
+
+/* parse_line: A line ends early at a null character.
+ */
+int parse_line(const char *line, const char *line_end, ParsedNode *parsed)
+{
+    const char *end = memchr(line, '\0', line_end - line);
+    end = end ? end : line_end;
+    parsed->blocks = create_block_array();
+    if (line == end) return EXIT_FAILURE;
+    const char *colon = memchr(line, ':', end - line);
+    const char *token_end = colon ? colon : end;
+    parsed->id = parse_id(line, token_end);
+    const char *cursor = token_end;
+    while (cursor < end && *cursor == ':') {
+        cursor++;
+    }
+    while (cursor < end) {
+        const char *comma = memchr(cursor, ',', end - cursor);
+        token_end = comma ? comma : end;
+        unsigned int bid = parse_id(cursor, token_end);
+        if (get_block(&parsed->blocks, bid) || append_block(&parsed->blocks, bid)) {
+            return EXIT_FAILURE;
+        }
+        cursor = token_end;
+        while (cursor < end && *cursor == ',') {
+            cursor++;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+unsigned int parse_id(const char *token, const char *token_end)
+{
+    int is_negative = token < token_end && *token == '-';
+    unsigned int id = 0;
+    for (token += is_negative; token < token_end && *token >= '0' && *token <= '9'; token++) {
+        id = id * 10 + (*token - '0');
+    }
+    return is_negative ? -id : id;
+}
+
+/* add_batches: Adds the parsed nodes in file order, up to the first line
+ * that failed.
+ */
+int add_batches(Blockchain *chain, TextRange *ranges, size_t num_ranges)
+{
+    for (size_t i = 0; i < num_ranges; i++) {
+        for (size_t j = 0; j < ranges[i].length; j++) {
+            ParsedNode *parsed = &ranges[i].batch[j];
+            if (has_node_with_id(chain, parsed->id)) return EXIT_FAILURE;
+            Node *node = new_node(chain, parsed->id);
+            if (!node) return EXIT_FAILURE;
+            set_own_blocks(node, &parsed->blocks);
+            if (add_node(chain, node)) {
+                free_node(chain, node);
+                return EXIT_FAILURE;
+            }
+        }
+        if (ranges[i].status) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void free_batches(TextRange *ranges, size_t num_ranges)
+{
+    for (size_t i = 0; i < num_ranges; i++) {
+        for (size_t j = 0; j < ranges[i].length; j++) {
+            free_block_array(&ranges[i].batch[j].blocks);
+        }
+        free(ranges[i].batch);
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include "blockchain_public.h"
+#include <stddef.h>
+
+int read_text(Blockchain *chain, const char *data, size_t size);
+
+#endif
@@ -0,0 +1,369 @@
+/* checkpoint.c: Decides what each save of the blockchain writes, and loads
+ * it back: a full save, or, in incremental mode, a delta holding only the
+ * nodes changed and removed since the last save (see blockchain/snapshot.c).
+ *
+ * A few "design" decisions:
+ *
+ * - Deltas are stacked on the full save, as <save>.1, <save>.2 and so on.
+ *   Every binary save starts a new lineage, a random number that the deltas
+ *   on top of it carry, along with their sequence: loading applies <save>.n
+ *   only if it carries the lineage loaded and sequence n, so that deltas
+ *   left behind by an older lineage are never applied.
+ *
+ * - Deltas need a binary base that the blockchain was loaded from or saved
+ *   to. A save is full when it is a text save, when no lineage was loaded
+ *   at startup and none saved since, or when some node removals could not
+ *   be recorded. Otherwise it is a delta, even the first save of a session
+ *   that started from a binary save.
+ *
+ * - Once MERGE_THRESHOLD deltas have piled up, a merger thread folds them
+ *   into a new full save of the same lineage and sequence, then removes
+ *   them, oldest first. It only reads files, so the session goes on
+ *   meanwhile. A crash in between leaves the newest of those deltas behind,
+ *   which loading removes, as it does any delta that does not apply.
+ *
+ * - The journal applies to the state given by checkpoints->id, which
+ *   changes with every save, whether full or delta, but not when deltas
+ *   are merged.
+ */
+
+#include <errno.h>                 // For ENOENT
+#include <limits.h>                // For ULONG_MAX
+#include <stdio.h>                 // For snprintf
+#include <stdlib.h>                // For EXIT_[X], malloc, free
+#include <string.h>                // For strlen
+#include <time.h>                  // For clock_gettime
+#include <fcntl.h>                 // For open
+#include <unistd.h>                // For close, getpid, unlink
+#include <sys/mman.h>              // For mmap
+#include <sys/stat.h>              // For fstat, stat
+
+#include "checkpoint.h"
+#include "blockchain/blockchain_public.h"
+
+#define MERGE_THRESHOLD 8
+
+static char *get_delta_name(const char *pathname, unsigned long sequence);
+static unsigned char *map_file(const char *pathname, size_t *size);
+static int load_delta(Checkpoints *checkpoints, unsigned long sequence);
+static unsigned long load_deltas(Checkpoints *checkpoints, unsigned long last_sequence);
+static void remove_stale_deltas(const Checkpoints *checkpoints);
+static void update_id(Checkpoints *checkpoints);
+static unsigned long new_lineage();
+static bool has_unsaved_changes(const Blockchain *chain);
+static int save_full(Checkpoints *checkpoints, SaveReport *report);
+static int save_delta(Checkpoints *checkpoints, SaveReport *report);
+static void start_merger(Checkpoints *checkpoints);
+static void *run_merger(void *arg);
+static void join_merger(Checkpoints *checkpoints);
+
+/* load_checkpoints: Loads the full save at pathname into chain, then the
+ * deltas on top of it; later checkpoints save chain. Should a delta turn
+ * out to be inconsistent, the blockchain is loaded again up to the one
+ * before it.
+ */
+int load_checkpoints(Checkpoints *checkpoints, Blockchain *chain, const char *pathname,
+                     SaveFormat format, bool is_incremental)
+{
+	checkpoints->chain = chain;
+	checkpoints->pathname = pathname;
+	checkpoints->format = format;
+	checkpoints->is_incremental = is_incremental;
+	checkpoints->has_merger = false;
+	atomic_init(&checkpoints->merge_is_done, false);
+	int result = load((char *) pathname, chain, &checkpoints->info);
+	// The full save has the sequence of the last delta merged into it.
+	checkpoints->base_sequence = checkpoints->info.sequence;
+	unsigned long failed_sequence = 0;
+	if (!result && checkpoints->info.lineage)
+		failed_sequence = load_deltas(checkpoints, ULONG_MAX);
+	if (failed_sequence) {
+		result = load((char *) pathname, chain, &checkpoints->info);
+		if (!result)
+			load_deltas(checkpoints, failed_sequence - 1);
+	}
+	// Deltas are only removed once their lineage has been loaded.
+	if (result) {
+		checkpoints->info.lineage = 0;
+		checkpoints->info.sequence = 0;
+		checkpoints->base_sequence = 0;
+	} else if (checkpoints->info.lineage) {
+		remove_stale_deltas(checkpoints);
+	}
+	struct stat status;
+	checkpoints->base_size = stat(pathname, &status) == -1 ? 0 : status.st_size;
+	update_id(checkpoints);
+	return result;
+}
+
+char *get_delta_name(const char *pathname, unsigned long sequence)
+{
+	size_t size = strlen(pathname) + 22;
+	char *delta_name = malloc(size);
+	if (delta_name)
+		snprintf(delta_name, size, "%s.%lu", pathname, sequence);
+	return delta_name;
+}
+
+/* map_file: Returns NULL if the file cannot be mapped, empty files
+ * included.
+ */
+unsigned char *map_file(const char *pathname, size_t *size)
+{
+	int fd = open(pathname, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	struct stat status;
+	unsigned char *data = MAP_FAILED;
+	if (fstat(fd, &status) != -1 && status.st_size > 0) {
+		*size = status.st_size;
+		data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	return data == MAP_FAILED ? NULL : data;
+}
+
+/* load_delta: Returns -1 if there is no delta of that sequence in the
+ * lineage loaded, in which case nothing was changed.
+ */
+int load_delta(Checkpoints *checkpoints, unsigned long sequence)
+{
+	char *delta_name = get_delta_name(checkpoints->pathname, sequence);
+	if (!delta_name)
+		return -1;
+	size_t size;
+	unsigned char *data = map_file(delta_name, &size);
+	free(delta_name);
+	if (!data)
+		return -1;
+	SnapshotInfo info;
+	int result = -1;
+	if (!read_snapshot_info(data, size, &info) && info.is_delta
+	        && info.lineage == checkpoints->info.lineage && info.sequence == sequence)
+		result = read_snapshot(checkpoints->chain, data, size);
+	munmap(data, size);
+	return result;
+}
+
+/* load_deltas: Returns the sequence of the delta that failed midway, if
+ * any, leaving the blockchain empty. Otherwise returns 0.
+ */
+unsigned long load_deltas(Checkpoints *checkpoints, unsigned long last_sequence)
+{
+	while (checkpoints->info.sequence < last_sequence) {
+		unsigned long sequence = checkpoints->info.sequence + 1;
+		int result = load_delta(checkpoints, sequence);
+		if (result == -1)
+			break;
+		if (result)
+			return sequence;
+		checkpoints->info.sequence = sequence;
+	}
+	return 0;
+}
+
+/* remove_stale_deltas: Removes the deltas already merged into the base,
+ * then those past the last one loaded.
+ */
+void remove_stale_deltas(const Checkpoints *checkpoints)
+{
+	for (unsigned long sequence = checkpoints->base_sequence; sequence > 0; sequence--) {
+		char *delta_name = get_delta_name(checkpoints->pathname, sequence);
+		int result = delta_name ? unlink(delta_name) : -1;
+		free(delta_name);
+		if (result == -1)
+			break;
+	}
+	for (unsigned long sequence = checkpoints->info.sequence + 1; ; sequence++) {
+		char *delta_name = get_delta_name(checkpoints->pathname, sequence);
+		int result = delta_name ? unlink(delta_name) : -1;
+		free(delta_name);
+		if (result == -1)
+			break;
+	}
+}
+
+/* update_id: Snapshots are told apart by lineage and sequence; text saves,
+ * and snapshots that predate lineages, by device and inode, a missing save
+ * counting as 0 and 0.
+ */
+void update_id(Checkpoints *checkpoints)
+{
+	if (checkpoints->info.lineage) {
+		snprintf(checkpoints->id, MAX_CHECKPOINT_ID_SIZE, "snapshot %lu %lu",
+		         checkpoints->info.lineage, checkpoints->info.sequence);
+		return;
+	}
+	struct stat status = { .st_dev = 0, .st_ino = 0 };
+	if (stat(checkpoints->pathname, &status) == -1 && errno != ENOENT)
+		status.st_ino = ULONG_MAX;
+	snprintf(checkpoints->id, MAX_CHECKPOINT_ID_SIZE, "file %lu %lu",
+	         (unsigned long) status.st_dev, (unsigned long) status.st_ino);
+}
+
+unsigned long new_lineage()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	unsigned long lineage = (unsigned long) now.tv_sec * 1000000000 + now.tv_nsec;
+	lineage ^= (unsigned long) getpid() << 20;
+	return lineage ? lineage : 1;
+}
+
+bool has_unsaved_changes(const Blockchain *chain)
+{
+	const UintIndex *removals = get_unsaved_removals(chain);
+	if (!removals || removals->size)
+		return true;
+	for (Node *node = get_nodes(chain); node; node = node->next) {
+		if (node->is_unsaved)
+			return true;
+	}
+	return false;
+}
+
+/* checkpoint: Saves the blockchain, as a delta if it can. Nothing is
+ * written if a delta would be empty.
+ */
+int checkpoint(Checkpoints *checkpoints, SaveReport *report)
+{
+	if (atomic_load(&checkpoints->merge_is_done))
+		join_merger(checkpoints);
+	if (!checkpoints->is_incremental || checkpoints->format == SAVE_TEXT
+	        || !checkpoints->info.lineage || !get_unsaved_removals(checkpoints->chain))
+		return save_full(checkpoints, report);
+	return save_delta(checkpoints, report);
+}
+
+size_t get_compaction_size(const Checkpoints *checkpoints)
+{
+	return checkpoints->is_incremental ? 0 : checkpoints->base_size;
+}
+
+/* save_full: Starts a new lineage, once the merger is done with the old
+ * one, then removes the deltas of the old one.
+ */
+int save_full(Checkpoints *checkpoints, SaveReport *report)
+{
+	join_merger(checkpoints);
+	SnapshotInfo info = {
+		.lineage = checkpoints->format == SAVE_TEXT ? 0 : new_lineage(),
+		.sequence = 0,
+		.is_delta = false,
+	};
+	if (save(checkpoints->pathname, checkpoints->chain, checkpoints->format, &info, report))
+		return EXIT_FAILURE;
+	declare_blockchain_saved(checkpoints->chain);
+	for (unsigned long sequence = checkpoints->base_sequence + 1;
+	     checkpoints->info.lineage && sequence <= checkpoints->info.sequence; sequence++) {
+		char *delta_name = get_delta_name(checkpoints->pathname, sequence);
+		if (delta_name)
+			unlink(delta_name);
+		free(delta_name);
+	}
+	checkpoints->info = info;
+	checkpoints->base_sequence = 0;
+	checkpoints->base_size = report->num_bytes;
+	update_id(checkpoints);
+	return EXIT_SUCCESS;
+}
+
+int save_delta(Checkpoints *checkpoints, SaveReport *report)
+{
+	if (!has_unsaved_changes(checkpoints->chain)) {
+		report->num_bytes = 0;
+		report->seconds = 0;
+		return EXIT_SUCCESS;
+	}
+	SnapshotInfo info = {
+		.lineage = checkpoints->info.lineage,
+		.sequence = checkpoints->info.sequence + 1,
+		.is_delta = true,
+	};
+	char *delta_name = get_delta_name(checkpoints->pathname, info.sequence);
+	if (!delta_name)
+		return EXIT_FAILURE;
+	int result = save(delta_name, checkpoints->chain, SAVE_BINARY, &info, report);
+	free(delta_name);
+	if (result)
+		return EXIT_FAILURE;
+	declare_blockchain_saved(checkpoints->chain);
+	checkpoints->info = info;
+	update_id(checkpoints);
+	if (info.sequence - checkpoints->base_sequence >= MERGE_THRESHOLD && !checkpoints->has_merger)
+		start_merger(checkpoints);
+	return EXIT_SUCCESS;
+}
+
+/* start_merger: Should the thread fail to start, the deltas are merged at
+ * a later checkpoint.
+ */
+void start_merger(Checkpoints *checkpoints)
+{
+	checkpoints->merge_lineage = checkpoints->info.lineage;
+	checkpoints->merge_sequence = checkpoints->info.sequence;
+	atomic_store(&checkpoints->merge_is_done, false);
+	if (!pthread_create(&checkpoints->merger, NULL, run_merger, checkpoints))
+		checkpoints->has_merger = true;
+}
+
+/* run_merger: Merges the deltas from base_sequence + 1 to merge_sequence
+ * into the base. Only reads the fields of checkpoints that stay the same
+ * until it is joined.
+ */
+void *run_merger(void *arg)
+{
+	Checkpoints *checkpoints = arg;
+	size_t num_snapshots = checkpoints->merge_sequence - checkpoints->base_sequence + 1;
+	const unsigned char **snapshots = calloc(num_snapshots, sizeof (unsigned char *));
+	size_t *sizes = calloc(num_snapshots, sizeof (size_t));
+	int result = !snapshots || !sizes;
+	for (size_t i = 0; !result && i < num_snapshots; i++) {
+		char *name = i ? get_delta_name(checkpoints->pathname, checkpoints->base_sequence + i)
+		               : NULL;
+		snapshots[i] = map_file(i ? name : checkpoints->pathname, &sizes[i]);
+		free(name);
+		result = !snapshots[i];
+	}
+	SnapshotInfo info = {
+		.lineage = checkpoints->merge_lineage,
+		.sequence = checkpoints->merge_sequence,
+		.is_delta = false,
+	};
+	SaveReport report = { .num_bytes = 0 };
+	if (!result)
+		result = save_merged(checkpoints->pathname, snapshots, sizes, num_snapshots, &info,
+		                     &report);
+	for (size_t i = 0; snapshots && sizes && i < num_snapshots && snapshots[i]; i++)
+		munmap((void *) snapshots[i], sizes[i]);
+	free(snapshots);
+	free(sizes);
+	for (size_t i = 1; !result && i < num_snapshots; i++) {
+		char *name = get_delta_name(checkpoints->pathname, checkpoints->base_sequence + i);
+		if (name)
+			unlink(name);
+		free(name);
+	}
+	checkpoints->merge_size = report.num_bytes;
+	checkpoints->merge_result = result;
+	atomic_store(&checkpoints->merge_is_done, true);
+	return NULL;
+}
+
+void join_merger(Checkpoints *checkpoints)
+{
+	if (!checkpoints->has_merger)
+		return;
+	pthread_join(checkpoints->merger, NULL);
+	checkpoints->has_merger = false;
+	atomic_store(&checkpoints->merge_is_done, false);
+	if (!checkpoints->merge_result) {
+		checkpoints->base_sequence = checkpoints->merge_sequence;
+		checkpoints->base_size = checkpoints->merge_size;
+	}
+}
+
+void close_checkpoints(Checkpoints *checkpoints)
+{
+	join_merger(checkpoints);
+}
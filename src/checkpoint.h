@@ -0,0 +1,41 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "save.h"
+#include "blockchain/snapshot.h"
+
+#define MAX_CHECKPOINT_ID_SIZE 64
+
+/* The saves chain is loaded from: a full save and, in incremental mode,
+ * the deltas on top of it. See checkpoint.c.
+ */
+typedef struct s_checkpoints {
+	Blockchain *chain;
+	const char *pathname;
+	SaveFormat format;
+	bool is_incremental;
+	SnapshotInfo info;
+	unsigned long base_sequence;
+	size_t base_size;
+	char id[MAX_CHECKPOINT_ID_SIZE];
+	bool has_merger;
+	pthread_t merger;
+	unsigned long merge_lineage;
+	unsigned long merge_sequence;
+	size_t merge_size;
+	int merge_result;
+	atomic_bool merge_is_done;
+} Checkpoints;
+
+int load_checkpoints(Checkpoints *checkpoints, Blockchain *chain, const char *pathname,
+                     SaveFormat format, bool is_incremental);
+int checkpoint(Checkpoints *checkpoints, SaveReport *report);
+size_t get_compaction_size(const Checkpoints *checkpoints);
+void close_checkpoints(Checkpoints *checkpoints);
+
+#endif // _CHECKPOINT_H
@@ -1,6 +1,6 @@
 /* commands.c contains all the high-level logic for the my_blockchain program.
  * The code divides roughly into two parts: The first contains functions 
- * new_cmd, free_cmd, and get_cmd which are primariy used for instantiating
+ * create_cmd, free_cmd, and get_cmd which are primariy used for instantiating
  * a struct Command using user input, and the second contains functions for 
  * each of the different blockchain commands (e.g. add_node, add_block, etc.)
  *
@@ -22,13 +22,23 @@
  * - Additionally, we opted to include 4 members bidlist, bidcount, nidlist,
  *   and nidcount in Command rather than create another struct to hold them.
  *
- * - new_cmd() uses a static instance of struct Command instead of malloc.
- *   The reason for doing this is to minimize free() calls in the parent fxn.
- *   Additionally, because only one instance of struct Command is ever required
- *   at any given time, this decision seemed appropriate. Note that free() 
- *   cannot be avoided entirely, as it is still required for [x]idlist members.
+ * - The caller owns its struct Command, from create_cmd(), and get_cmd()
+ *   fills the same one in for every command instead of malloc'ing a new
+ *   one. Its [x]idlist members are kept from one command to the next and
+ *   only freed at the end.
+ *
+ * - The cmd_[X] functions run on the blockchain they are given. Only the
+ *   session, the blockchain load_blockchain() returns along with its saves
+ *   and journal, is kept in file-scope statics, there being one per
+ *   process.
+ *
+ * - Each cmd_[X] holds the blockchain's lock while it runs, for reading in
+ *   ls and mem, for writing otherwise, and so do the prompt and the saves,
+ *   so that other threads may use the blockchain in the meantime.
  */
 
+#include <limits.h>                          // For UINT_MAX
+#include <stdint.h>                          // For SIZE_MAX
 #include <stdio.h>                           // For printf
 #include <stdlib.h>                          // For EXIT_[X]
 #include <unistd.h>                          // For STDIN
@@ -36,14 +46,28 @@
 #include "commands.h"
 #include "blockchain/blockchain_public.h"
 #include "save.h"
+#include "checkpoint.h"
+#include "journal.h"
 #include "parse.h"
 #include "error.h"
+#include "stats.h"
 #include "utils/_string.h"
 #include "utils/_readline.h"
+#include "utils/mem.h"
+#include "utils/writer.h"
 
 #define SAVE_PATHNAME "my_blockchain.save"
+#define JOURNAL_PATHNAME "my_blockchain.journal"
 #define MAX_PROMPT_SIZE 64
 
+static Blockchain *blockchain;
+static Checkpoints checkpoints;
+static Journal journal;
+static ReadBuffer input;
+// What ls and where print, on STDOUT. See get_output().
+static Writer output;
+static bool has_output = false;
+
 /* print_cmd: Used for debugging - prints struct Command.
  */
 void print_cmd(Command *command)
@@ -65,47 +89,53 @@ void print_cmd(Command *command)
 	printf("\n");
 }
 
-/* new_cmd(): Uses a static instance of struct Command instead of malloc.
- * The reason for doing this is to minimize free() calls in the parent fxn.
- * Additionally, because only one instance of struct Command is ever required
- * at any given time, this decision seemed appropriate.
- *
- * With that being said, still need to malloc memory for .xidlist member.
- * Therefore, before each new call to new_cmd(), we need to free this memory.
+/* reset_cmd: The .[x]idlist members are kept, with their capacity, so that
+ * parse_id_list() can reuse them: only the counts are reset.
  */
-static Command *new_cmd()
-{
-	static Command command;
-	free_cmd(&command);
-	Command resetcommand = {
-		.maincmd = UNDEFINED,
-		.lflag = false,
-		.all = false,
+void reset_cmd(Command *command)
+{
+	command->maincmd = UNDEFINED;
+	command->lflag = false;
+	command->cflag = false;
+	command->all = false;
+	command->nidmin = 0;
+	command->nidmax = UINT_MAX;
+	command->maxnodes = SIZE_MAX;
+	command->maxblocks = SIZE_MAX;
+	command->nidcount = 0;
+	command->bidcount = 0;
+}
+
+/* create_cmd: Returns an empty Command, with no [x]idlist allocated yet,
+ * to be passed to get_cmd() for every command.
+ */
+Command create_cmd()
+{
+	Command command = {
 		.nidlist = NULL,
-		.nidcount = 0,
+		.nidcapacity = 0,
 		.bidlist = NULL,
-		.bidcount = 0,
+		.bidcapacity = 0,
 	};
-	command = resetcommand;
-	return &command;
+	reset_cmd(&command);
+	return command;
 }
 
 /* free_cmd: Needed for freeing just the memory allocated in parse_id_list().
- * While struct Command is a static instance, the .[x]idlist needs to point to 
- * malloc'd memory. Thus this memory needs to be freed at the very end of the
- * program AND right before each new call of new_cmd(). If not, new_cmd() will
- * reset .[x]idlist = NULL and memory will leak.
+ * The .[x]idlist members point to malloc'd memory, which get_cmd() keeps
+ * for the next command. Thus this memory needs to be freed once the
+ * Command is no longer needed.
  */
 void free_cmd(Command *command)
 {
-	if (command->nidlist) {
-		free(command->nidlist);
-		command->nidlist = NULL;
-	}
-	if (command->bidlist) {
-		free(command->bidlist);
-		command->bidlist = NULL;
-	}
+	mem_free(MEM_PARSE, command->nidlist, sizeof(unsigned int) * command->nidcapacity);
+	command->nidlist = NULL;
+	command->nidcapacity = 0;
+	command->nidcount = 0;
+	mem_free(MEM_PARSE, command->bidlist, sizeof(unsigned int) * command->bidcapacity);
+	command->bidlist = NULL;
+	command->bidcapacity = 0;
+	command->bidcount = 0;
 }
 
 /* print_prompt: prints either [sX] or [-X] where X is the number of 
@@ -114,8 +144,10 @@ void free_cmd(Command *command)
  */
 void print_prompt() 
 {
-	char sync_state = blockchain_is_synced() ? 's' : '-';
-	size_t n_nodes = get_num_nodes();
+	lock_blockchain_for_reading(blockchain);
+	char sync_state = blockchain_is_synced(blockchain) ? 's' : '-';
+	size_t n_nodes = get_num_nodes(blockchain);
+	unlock_blockchain(blockchain);
 	char buffer[MAX_PROMPT_SIZE];
 	// If try and use printf, may not always print before the
 	// _readline command due to buffering / compiler optimization.
@@ -123,60 +155,265 @@ void print_prompt()
 	write(STDIN_FILENO, buffer, _strlen(buffer));
 }
 
+/* get_output: The Writer that ls and where print through, created on first
+ * use and kept until quitting, so that a listing costs one write per 64 KiB
+ * rather than a printf per node and per block. It is flushed before each
+ * prompt, or in batch mode only once full.
+ */
+static Writer *get_output()
+{
+	if (!has_output) {
+		if (create_writer(&output, STDOUT_FILENO))
+			return NULL;
+		has_output = true;
+	}
+	return &output;
+}
+
+static void flush_output()
+{
+	if (has_output)
+		flush_writer(&output);
+}
+
 /* get_cmd: Really just a wrapper function that combines printing the
- * prompt, reading from STDIN, then parsing the string to get Command.
+ * prompt, reading from STDIN, then parsing the string into command, which
+ * it returns. In batch mode there is no prompt, and the end of the input
+ * quits.
  */
-Command *get_cmd()
+Command *get_cmd(const Options *options, Command *command)
 {
-	print_prompt();
-	Command *command = new_cmd();
-	char *line = _readline(STDIN_FILENO);
+	if (!options->batch) {
+		flush_output();
+		start_stage();
+		print_prompt();
+		end_stage(STAGE_PROMPT);
+	}
+	reset_cmd(command);
+	size_t length;
+	char *line = _readline_view(&input, STDIN_FILENO, &length);
+	start_stage();
+	if (!line && options->batch) {
+		command->maincmd = QUIT;
+		return command;
+	}
 	parse_cmd(command, line);
-	free(line);
+	end_stage(STAGE_PARSE);
 	return command;
 }
 
-int load_blockchain()
+/* refresh_sync_state: update_sync_state(), timed apart from the rest of
+ * the command for the stats.
+ */
+static void refresh_sync_state(Blockchain *chain)
+{
+	end_stage(STAGE_EXECUTE);
+	update_sync_state(chain);
+	end_stage(STAGE_SYNC_STATE);
+}
+
+/* start_batch: In batch mode, starts buffering errors and timing the
+ * commands, which are then tallied by count_cmd().
+ */
+BatchReport start_batch(const Options *options)
+{
+	BatchReport report = {
+		.is_batch = options->batch && !buffer_errors(true),
+		.num_ok = 0,
+		.num_nok = 0,
+		.num_errors = get_num_errors(),
+	};
+	clock_gettime(CLOCK_MONOTONIC, &report.start);
+	return report;
+}
+
+void count_cmd(BatchReport *report, const Command *command)
+{
+	if (command->maincmd == EMPTY)
+		return;
+	size_t num_errors = get_num_errors();
+	if (num_errors != report->num_errors)
+		report->num_nok++;
+	else
+		report->num_ok++;
+	report->num_errors = num_errors;
+}
+
+/* end_batch: Writes out the buffered errors, then how many commands ran,
+ * how many failed, and how fast.
+ */
+void end_batch(const BatchReport *report)
+{
+	if (!report->is_batch)
+		return;
+	buffer_errors(false);
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - report->start.tv_sec)
+	                 + (end.tv_nsec - report->start.tv_nsec) / 1e9;
+	size_t num_cmds = report->num_ok + report->num_nok;
+	dprintf(STDERR_FILENO, "ran %zu commands (%zu ok, %zu nok) in %.3f s, %.0f per second\n",
+	        num_cmds, report->num_ok, report->num_nok, seconds,
+	        seconds > 0 ? num_cmds / seconds : 0);
+}
+
+/* replay_cmd: Runs a command read back from the journal. Its errors were
+ * printed when it was first run.
+ */
+static void replay_cmd(char *line)
+{
+	Command replayed = create_cmd();
+	Command *command = &replayed;
+	parse_cmd(command, line);
+	silence_errors(true);
+	switch (command->maincmd) {
+	case ADD_NODE:
+		cmd_add_node(blockchain, command);
+		break;
+	case ADD_BLOCK:
+		cmd_add_block(blockchain, command);
+		break;
+	case RM_NODE:
+		cmd_rm_node(blockchain, command);
+		break;
+	case RM_BLOCK:
+		cmd_rm_block(blockchain, command);
+		break;
+	case SYNC:
+		cmd_sync(blockchain);
+		break;
+	default:
+		break;
+	}
+	silence_errors(false);
+	free_cmd(command);
+}
+
+static Blockchain *fail_load()
+{
+	print_error(ERROR_ID_NO_RESOURCES);
+	close_checkpoints(&checkpoints);
+	free_blockchain(blockchain);
+	blockchain = NULL;
+	return NULL;
+}
+
+/* load_blockchain: Creates the session's blockchain, loads the last save
+ * into it, then replays the commands that followed it, if the previous
+ * session did not quit. There being no save is no failure. Returns the
+ * blockchain, which cmd_quit() frees, or NULL.
+ *
+ * With -m, the save or the journal may not fit under the memory limit.
+ * Going on from part of them would save that part over the whole, or drop
+ * a journal that no longer matches, so the load fails instead, leaving
+ * both files as they were.
+ */
+Blockchain *load_blockchain(const Options *options)
+{
+	blockchain = new_blockchain();
+	if (!blockchain || set_sync_threads(blockchain, options->sync_threads)) {
+		free_blockchain(blockchain);
+		blockchain = NULL;
+		print_error(ERROR_ID_NO_RESOURCES);
+		return NULL;
+	}
+	load_checkpoints(&checkpoints, blockchain, SAVE_PATHNAME, options->save_format,
+	                 options->incremental);
+	if (get_num_mem_rejections())
+		return fail_load();
+	open_journal(&journal, JOURNAL_PATHNAME, checkpoints.id, get_compaction_size(&checkpoints),
+	             replay_cmd, options->journal_records, options->journal_delay_ms);
+	if (get_num_mem_rejections()) {
+		close_journal(&journal);
+		return fail_load();
+	}
+	return blockchain;
+}
+
+/* record_cmd: Writes command to the journal before it is run. A command
+ * that cannot be written is not to be run.
+ */
+int record_cmd(const Command *command)
+{
+	if (!is_journaled(command))
+		return EXIT_SUCCESS;
+	if (journal_cmd(&journal, command)) {
+		print_error(ERROR_ID_NO_RESOURCES);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* compact_journal: Once the journal is full, saves the blockchain and
+ * starts the journal anew.
+ */
+int compact_journal()
+{
+	if (!journal_is_full(&journal))
+		return EXIT_SUCCESS;
+	SaveReport report;
+	lock_blockchain_for_writing(blockchain);
+	int save_result = checkpoint(&checkpoints, &report);
+	unlock_blockchain(blockchain);
+	if (save_result)
+		return EXIT_FAILURE;
+	return reset_journal(&journal, checkpoints.id, get_compaction_size(&checkpoints));
+}
+
+/* run_writer: Runs command on chain under its write lock.
+ */
+static int run_writer(int (*run)(Blockchain *, Command *), Blockchain *chain,
+                      Command *command)
 {
-	return load(SAVE_PATHNAME);
+	lock_blockchain_for_writing(chain);
+	int result = run(chain, command);
+	unlock_blockchain(chain);
+	return result;
 }
 
-int cmd_add_node(Command *command)
+static int add_node_cmd(Blockchain *chain, Command *command)
 {
 	unsigned int nid = *(command->nidlist);
-	if (has_node_with_id(nid)) {
+	if (has_node_with_id(chain, nid)) {
 		print_error(ERROR_ID_NODE_EXISTS);
 		return EXIT_FAILURE;
 	}
-	Node *node = new_node(nid);
+	Node *node = new_node(chain, nid);
 	if (!node) {
 		print_error(ERROR_ID_NO_RESOURCES);
 		return EXIT_FAILURE;
 	}
-	add_node(node);
+	if (add_node(chain, node)) {
+		free_node(chain, node);
+		print_error(ERROR_ID_NO_RESOURCES);
+		return EXIT_FAILURE;
+	}
 	return EXIT_SUCCESS;
 }
 
-int cmd_add_block(Command *command)
+int cmd_add_node(Blockchain *chain, Command *command)
+{
+	return run_writer(add_node_cmd, chain, command);
+}
+
+static int add_block_cmd(Blockchain *chain, Command *command)
 {
 	unsigned int bid = *(command->bidlist);
 	int blocks_added = 0;
 
 	// If all nodes to be impacted
 	if (command->all) {
-		Node *node = get_nodes();
+		Node *node = get_nodes(chain);
 		while (node) {
 			if (has_block_with_id(bid, node)) {
                 print_error(ERROR_ID_BLOCK_EXISTS);
 			    node = node->next;
 				continue;
 			}
-			Block *block = new_block(bid);
-			if (!block) {
+			if (add_block(bid, node)) {
 				print_error(ERROR_ID_NO_RESOURCES);
 				return EXIT_FAILURE;
 			}
-			add_block(block, node);
 			blocks_added++;
 			node = node->next;
 		}
@@ -187,40 +424,42 @@ int cmd_add_block(Command *command)
 		unsigned int *nidlist = command->nidlist;
 		size_t nidcount = command->nidcount;
 		for (size_t i = 0; i < nidcount; i++) {
-			unsigned int nid = *(nidlist + i);
-			if (!has_node_with_id(nid)) {
+			Node *node = get_node_from_id(chain, *(nidlist + i));
+			if (!node) {
 			    print_error(ERROR_ID_NODE_NOT_EXISTS);
                 continue;
 			}
-			Node *node = get_node_from_id(nid);
 			if (has_block_with_id(bid, node)) {
                 print_error(ERROR_ID_BLOCK_EXISTS);
                 continue;
 			}
-			Block *block = new_block(bid);
-			if (!block) {
+			if (add_block(bid, node)) {
 				print_error(ERROR_ID_NO_RESOURCES);
 				return EXIT_FAILURE;
 			}
-			add_block(block, node);
 			blocks_added++;
 		}
 	}
 
-	update_sync_state();
+	refresh_sync_state(chain);
 	return EXIT_SUCCESS;
 }
 
-int cmd_rm_node(Command *command)
+int cmd_add_block(Blockchain *chain, Command *command)
+{
+	return run_writer(add_block_cmd, chain, command);
+}
+
+static int rm_node_cmd(Blockchain *chain, Command *command)
 {
 	int nodes_removed = 0;
 
 	// If all nodes to be deleted
 	if (command->all) {
-		Node *node = get_nodes();
+		Node *node = get_nodes(chain);
 		while (node) {
 			Node *next_node = node->next;
-			rmv_node(node);
+			rmv_node(chain, node);
 			nodes_removed++;
 			node = next_node;
 		}
@@ -232,14 +471,14 @@ int cmd_rm_node(Command *command)
 		unsigned int *nidlist = command->nidlist;
 		size_t nidcount = command->nidcount;
 		for (size_t i = 0; i < nidcount; i++) {
-			unsigned int nid = *(nidlist + i);
-			if (!has_node_with_id(nid)) continue;
-			rmv_node(get_node_from_id(nid));
+			Node *node = get_node_from_id(chain, *(nidlist + i));
+			if (!node) continue;
+			rmv_node(chain, node);
 			nodes_removed++;
 		}
 	}
 
-	update_sync_state();
+	refresh_sync_state(chain);
 	if (!nodes_removed) {
 		print_error(ERROR_ID_NODE_NOT_EXISTS);
 		return EXIT_FAILURE;
@@ -247,26 +486,21 @@ int cmd_rm_node(Command *command)
 	return EXIT_SUCCESS;
 }
 
-int cmd_rm_block(Command *command)
+int cmd_rm_node(Blockchain *chain, Command *command)
 {
-	int blocks_removed = 0;
+	return run_writer(rm_node_cmd, chain, command);
+}
 
-	unsigned int *bidlist = command->bidlist;
-	size_t bidcount = command->bidcount;
-	for (size_t i = 0; i < bidcount; i++) {
-		unsigned int bid = *(bidlist + i);
-		Node *node = get_nodes();
-		while (node) {
-			if (!has_block_with_id(bid, node)) {
-				node = node->next;
-				continue;
-			};
-			rmv_block(get_block_from_id(bid, node), node);
-			blocks_removed++;
-			node = node->next;
-		}
+static int rm_block_cmd(Blockchain *chain, Command *command)
+{
+	size_t blocks_removed = 0;
+	int status = rmv_blocks_from_all_nodes(chain, command->bidlist, command->bidcount,
+	                                       &blocks_removed);
+	refresh_sync_state(chain);
+	if (status) {
+		print_error(ERROR_ID_NO_RESOURCES);
+		return EXIT_FAILURE;
 	}
-	update_sync_state();
 	// We only print error if no blocks were found throughout all nodes.
 	// If one node has block but the rest don't, shouldn't show error.
 	// Also if multiple blocks provided and some never appear, so long 
@@ -278,24 +512,125 @@ int cmd_rm_block(Command *command)
 	return EXIT_SUCCESS;
 }
 
-void cmd_ls(Command *command)
+int cmd_rm_block(Blockchain *chain, Command *command)
 {
-	Node *node = get_nodes();
-	while (node) {
-		printf("%d: ", node->id);
-		Block *block = node->head;
-		while (command->lflag && block) {
-			printf("%d, ", block->id);
-			block = block->next;
+	return run_writer(rm_block_cmd, chain, command);
+}
+
+/* write_node: Writes the id of node, then with -l its blocks, "..."
+ * standing for those past maxblocks.
+ */
+static void write_node(Writer *writer, const Node *node, const Command *command)
+{
+	write_uint(writer, node->id);
+	write_bytes(writer, ": ", 2);
+	size_t num_blocks = 0;
+	Block *block = command->lflag ? first_block(node) : NULL;
+	while (block) {
+		if (num_blocks++ == command->maxblocks) {
+			write_bytes(writer, "...", 3);
+			break;
 		}
-		printf("\n");
-		node = node->next;
+		write_uint(writer, block->id);
+		write_bytes(writer, ", ", 2);
+		block = next_block(node, block);
+	}
+	write_char(writer, '\n');
+}
+
+/* cmd_ls: Lists the nodes with ids from nidmin to nidmax, up to maxnodes
+ * of them, "..." standing for the rest. With -c, only prints how many
+ * nodes are listed and how many blocks they hold.
+ */
+void cmd_ls(Blockchain *chain, Command *command)
+{
+	Writer *writer = get_output();
+	if (!writer) {
+		print_error(ERROR_ID_NO_RESOURCES);
+		return;
+	}
+	lock_blockchain_for_reading(chain);
+	size_t num_nodes = 0;
+	size_t num_blocks = 0;
+	// A single node is looked up rather than searched for.
+	Node *node = command->nidmin == command->nidmax
+	             ? get_node_from_id(chain, command->nidmin) : get_nodes(chain);
+	for (; node; node = node->next) {
+		if (node->id < command->nidmin || node->id > command->nidmax)
+			continue;
+		if (num_nodes == command->maxnodes) {
+			if (!command->cflag)
+				write_bytes(writer, "...\n", 4);
+			break;
+		}
+		num_nodes++;
+		if (command->cflag)
+			num_blocks += get_num_blocks(node);
+		else
+			write_node(writer, node, command);
+		if (command->nidmin == command->nidmax)
+			break;
+	}
+	if (command->cflag) {
+		write_uint(writer, num_nodes);
+		write_bytes(writer, " nodes, ", 8);
+		write_uint(writer, num_blocks);
+		write_bytes(writer, " blocks\n", 8);
 	}
+	unlock_blockchain(chain);
 }
 
-int cmd_sync() 
+static int compare_node_ids(const void *node, const void *other)
 {
-	int sync_result = synchronize();
+	unsigned int id = (*(Node * const *) node)->id;
+	unsigned int other_id = (*(Node * const *) other)->id;
+	return (id > other_id) - (id < other_id);
+}
+
+/* where_block_cmd: Lists the nodes holding the block, by increasing id.
+ * Only the nodes that hold it are looked at.
+ */
+static int where_block_cmd(Blockchain *chain, Command *command)
+{
+	NodeList nodes = create_node_list();
+	if (find_nodes_with_block(chain, *command->bidlist, &nodes)) {
+		free_node_list(&nodes);
+		print_error(ERROR_ID_NO_RESOURCES);
+		return EXIT_FAILURE;
+	}
+	if (!nodes.length) {
+		free_node_list(&nodes);
+		print_error(ERROR_ID_BLOCK_NOT_EXISTS);
+		return EXIT_FAILURE;
+	}
+	Writer *writer = get_output();
+	if (!writer) {
+		free_node_list(&nodes);
+		print_error(ERROR_ID_NO_RESOURCES);
+		return EXIT_FAILURE;
+	}
+	qsort(nodes.nodes, nodes.length, sizeof (Node *), compare_node_ids);
+	for (size_t i = 0; i < nodes.length; i++) {
+		write_uint(writer, nodes.nodes[i]->id);
+		write_char(writer, '\n');
+	}
+	free_node_list(&nodes);
+	return EXIT_SUCCESS;
+}
+
+/* cmd_where_block: Takes the write lock, as the first where builds the
+ * index of which nodes hold each block.
+ */
+int cmd_where_block(Blockchain *chain, Command *command)
+{
+	return run_writer(where_block_cmd, chain, command);
+}
+
+int cmd_sync(Blockchain *chain)
+{
+	lock_blockchain_for_writing(chain);
+	int sync_result = synchronize(chain);
+	unlock_blockchain(chain);
 	if (sync_result == EXIT_FAILURE) {
 		print_error(ERROR_ID_NO_RESOURCES);
 		return EXIT_FAILURE;
@@ -303,13 +638,62 @@ int cmd_sync()
 	return EXIT_SUCCESS;
 }
 
-int cmd_quit()
+int cmd_quit(const Options *options)
 {
-	save(SAVE_PATHNAME, get_nodes());
-	free_blockchain();
+	SaveReport report;
+	lock_blockchain_for_writing(blockchain);
+	int save_result = checkpoint(&checkpoints, &report);
+	unlock_blockchain(blockchain);
+	close_checkpoints(&checkpoints);
+	if (options->stats_pathname)
+		dump_stats(options->stats_pathname);
+	flush_output();
+	if (has_output) {
+		free_writer(&output);
+		has_output = false;
+	}
+	// Buffered errors came first.
+	flush_errors();
+	if (options->verbose && !save_result)
+		dprintf(STDERR_FILENO, "saved %zu bytes in %.3f s\n", report.num_bytes, report.seconds);
+	// Once saved, the journal no longer applies. Otherwise it is kept, so
+	// that the next session can still recover this one.
+	close_journal(&journal);
+	if (!save_result)
+		unlink(JOURNAL_PATHNAME);
+	free_read_buffer(&input);
+	free_blockchain(blockchain);
+	blockchain = NULL;
 	return EXIT_SUCCESS;
 }
 
+/* cmd_stats: Prints the latency stats of the commands run so far. */
+void cmd_stats()
+{
+	Writer *writer = get_output();
+	if (!writer) {
+		print_error(ERROR_ID_NO_RESOURCES);
+		return;
+	}
+	write_stats(writer);
+}
+
+/* cmd_mem: Prints how much memory the blockchain takes, and what for. */
+void cmd_mem(Blockchain *chain)
+{
+	Writer *writer = get_output();
+	if (!writer) {
+		print_error(ERROR_ID_NO_RESOURCES);
+		return;
+	}
+	lock_blockchain_for_reading(chain);
+	size_t num_blocks = 0;
+	for (Node *node = get_nodes(chain); node; node = node->next)
+		num_blocks += get_num_blocks(node);
+	write_mem_stats(writer, get_num_nodes(chain), num_blocks);
+	unlock_blockchain(chain);
+}
+
 void cmd_not_found()
 {
 	print_error(ERROR_ID_CMD_NOT_FOUND);
@@ -1,35 +1,66 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include "options.h"
+#include "blockchain/blockchain_public.h"
 #include "utils/uint_array.h"
 #include <stdbool.h>
+#include <time.h>
 
 typedef enum e_cmd { UNDEFINED, EMPTY, ADD_NODE, ADD_BLOCK, RM_NODE,
-             RM_BLOCK, LS, SYNC, QUIT } MainCmd;
+             RM_BLOCK, LS, WHERE_BLOCK, SYNC, QUIT, STATS, MEM } MainCmd;
 
 typedef struct s_command {
 	MainCmd maincmd;
 	bool lflag;
+	bool cflag;
 	bool all;
+	unsigned int nidmin;
+	unsigned int nidmax;
+	size_t maxnodes;
+	size_t maxblocks;
 	unsigned int *nidlist;
 	size_t nidcount;
+	size_t nidcapacity;
 	unsigned *bidlist;
 	size_t bidcount;
+	size_t bidcapacity;
 } Command;
 
+/* Tally of the commands run in batch mode, summed up on exit. A command is
+ * nok if it printed an error.
+ */
+typedef struct s_batch_report {
+	bool is_batch;
+	size_t num_ok;
+	size_t num_nok;
+	size_t num_errors;
+	struct timespec start;
+} BatchReport;
+
+Command create_cmd();
+void reset_cmd(Command *command);
 void free_cmd(Command *command);
 void print_cmd(Command *command);
 void print_prompt();
-Command *get_cmd();
-int load_blockchain();
+Command *get_cmd(const Options *options, Command *command);
+BatchReport start_batch(const Options *options);
+void count_cmd(BatchReport *report, const Command *command);
+void end_batch(const BatchReport *report);
+Blockchain *load_blockchain(const Options *options);
+int record_cmd(const Command *command);
+int compact_journal();
 
-int cmd_add_node(Command *command);
-int cmd_add_block(Command *command);
-int cmd_rm_node(Command *command);
-int cmd_rm_block(Command *command);
-void cmd_ls(Command *command);
-int cmd_sync();
-int cmd_quit();
+int cmd_add_node(Blockchain *chain, Command *command);
+int cmd_add_block(Blockchain *chain, Command *command);
+int cmd_rm_node(Blockchain *chain, Command *command);
+int cmd_rm_block(Blockchain *chain, Command *command);
+void cmd_ls(Blockchain *chain, Command *command);
+int cmd_where_block(Blockchain *chain, Command *command);
+int cmd_sync(Blockchain *chain);
+void cmd_stats();
+void cmd_mem(Blockchain *chain);
+int cmd_quit(const Options *options);
 void cmd_not_found();
 
 #endif
@@ -1,7 +1,52 @@
 #include <stdio.h>                           // For printf
+#include <stdlib.h>                          // For EXIT_[X]
 #include <unistd.h>                          // For STDIN
 
 #include "error.h"
+#include "utils/_string.h"                   // For _strlen
+#include "utils/writer.h"
+
+static bool errors_are_silenced = false;
+static bool errors_are_buffered = false;
+static Writer error_writer;
+static size_t num_errors = 0;
+
+/* silence_errors: While silenced, print_error prints nothing. Used when
+ * replaying commands whose errors were already printed once.
+ */
+void silence_errors(bool is_silenced)
+{
+	errors_are_silenced = is_silenced;
+}
+
+/* buffer_errors: While buffered, print_error gathers the messages in a
+ * buffer, written to STDERR only once it fills up or is flushed, rather
+ * than with one write per message. Used in batch mode. Unbuffering flushes
+ * what is left.
+ */
+int buffer_errors(bool is_buffered)
+{
+	if (is_buffered == errors_are_buffered)
+		return EXIT_SUCCESS;
+	if (is_buffered) {
+		if (create_writer(&error_writer, STDERR_FILENO))
+			return EXIT_FAILURE;
+		errors_are_buffered = true;
+		return EXIT_SUCCESS;
+	}
+	int flush_result = flush_writer(&error_writer);
+	free_writer(&error_writer);
+	errors_are_buffered = false;
+	return flush_result;
+}
+
+/* flush_errors: Writes out the messages buffered so far, if any. */
+int flush_errors()
+{
+	if (!errors_are_buffered)
+		return EXIT_SUCCESS;
+	return flush_writer(&error_writer);
+}
 
 /* print_error: Prints error message to STDERR. Most are self-explanatory
  * except perhaps ERROR_ID_NO_RESOURCES. Error occurs when add_block, add_node,
@@ -30,6 +75,24 @@ void print_error(short error_id)
 	case ERROR_ID_CMD_NOT_FOUND:
 		error_msg = "command not found";
 		break;
+	default:
+		return;
+	}
+	if (errors_are_silenced)
+		return;
+	num_errors++;
+	if (errors_are_buffered) {
+		write_bytes(&error_writer, error_msg, _strlen(error_msg));
+		write_char(&error_writer, '\n');
+		return;
 	}
 	dprintf(STDERR_FILENO, "%s\n", error_msg);
 }
+
+/* get_num_errors: How many errors were printed so far, silenced ones
+ * aside.
+ */
+size_t get_num_errors()
+{
+	return num_errors;
+}
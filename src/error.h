@@ -1,11 +1,18 @@
 #ifndef _PRINT_ERROR_H
 #define _PRINT_ERROR_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef enum e_error_id { ERROR_ID_UNDEFINED, ERROR_ID_NO_RESOURCES,
                           ERROR_ID_NODE_EXISTS, ERROR_ID_BLOCK_EXISTS,
                           ERROR_ID_NODE_NOT_EXISTS, ERROR_ID_BLOCK_NOT_EXISTS,
                           ERROR_ID_CMD_NOT_FOUND } Error_ID;
 
+void silence_errors(bool is_silenced);
+int buffer_errors(bool is_buffered);
+int flush_errors();
 void print_error(short error_id);
+size_t get_num_errors();
 
 #endif // _PRINT_ERROR_H
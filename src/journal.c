@@ -0,0 +1,348 @@
+/* journal.c: Write-ahead journal of the commands that change the blockchain
+ * (add node/block, rm node/block and sync), so that a session that ends
+ * without quit loses at most the commands not yet synced to disk.
+ *
+ * A few "design" decisions:
+ *
+ * - The journal is a text file. Its first line names the save it applies
+ *   to, by its checkpoint id (see checkpoint.c); every other line is one command, in
+ *   the form it is typed in. Replaying the commands over that save, in
+ *   order, rebuilds the blockchain exactly, as commands are deterministic.
+ *
+ * - A command is written before it is run, with a single write(2), so that
+ *   it survives the process crashing. Syncing it to disk is left to group
+ *   commit: the journal is synced once max_unsynced commands are waiting,
+ *   or max_delay_ms after the first of them, by a flusher thread if no
+ *   other command comes in meanwhile.
+ *
+ * - Saving the blockchain, in full or as a delta, gives it a new checkpoint
+ *   id, at which point the journal no longer applies and is simply started
+ *   anew. A crash in between leaves a journal naming the old id, which is
+ *   ignored. The journal is compacted that way once it is larger than the
+ *   save itself, so that replaying it never costs more than loading, or,
+ *   as deltas cost little, once it passes MIN_COMPACTION_SIZE.
+ *
+ * - A last line cut short by a crash was never fully written, hence never
+ *   run; it is dropped.
+ */
+
+#include <errno.h>                 // For ETIMEDOUT
+#include <stdio.h>                 // For snprintf, rename
+#include <stdlib.h>                // For EXIT_[X], free
+#include <string.h>                // For memchr, memcmp
+#include <fcntl.h>                 // For open
+#include <unistd.h>                // For fsync, ftruncate, lseek, close
+#include <sys/mman.h>              // For mmap
+#include <sys/stat.h>              // For fstat
+
+#include "journal.h"
+#include "save.h"                  // For get_temp_name, sync_directory
+
+#define MAX_HEADER_SIZE 96
+// Journals smaller than this are never compacted, however small the save.
+#define MIN_COMPACTION_SIZE (1 << 20)
+
+static void get_header(const char *checkpoint_id, char *header);
+static int replay_journal(Journal *journal, const char *checkpoint_id, ReplayFn replay);
+static int create_journal_file(Journal *journal, const char *checkpoint_id);
+static void format_cmd(Writer *writer, const Command *command);
+static void format_ids(Writer *writer, const unsigned int *ids, size_t count);
+static long get_ms_since(const struct timespec *start);
+static int sync_unsynced(Journal *journal);
+static void *run_flusher(void *arg);
+
+/* open_journal: Replays the journal left by the previous session, if it
+ * applies to the blockchain as loaded, checkpoint_id, and keeps adding to
+ * it. Otherwise, starts a new one. The journal is full once it is larger
+ * than save_size. On failure, the journal stays closed and journal_cmd()
+ * does nothing.
+ */
+int open_journal(Journal *journal, const char *pathname, const char *checkpoint_id,
+                 size_t save_size, ReplayFn replay, size_t max_unsynced, long max_delay_ms)
+{
+	journal->pathname = pathname;
+	journal->fildes = -1;
+	journal->size = 0;
+	journal->save_size = save_size;
+	journal->max_unsynced = max_unsynced;
+	journal->max_delay_ms = max_delay_ms;
+	journal->num_unsynced = 0;
+	journal->has_flusher = false;
+	journal->is_closing = false;
+	pthread_mutex_init(&journal->lock, NULL);
+	// Deadlines are taken from the monotonic clock, as are record times.
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&journal->has_unsynced, &attr);
+	pthread_condattr_destroy(&attr);
+	if (create_writer(&journal->writer, -1))
+		return EXIT_FAILURE;
+	int result = replay_journal(journal, checkpoint_id, replay);
+	if (result == -1)
+		result = create_journal_file(journal, checkpoint_id);
+	if (result)
+		return EXIT_FAILURE;
+	if (max_unsynced > 1 && !pthread_create(&journal->flusher, NULL, run_flusher, journal))
+		journal->has_flusher = true;
+	return EXIT_SUCCESS;
+}
+
+bool is_journaled(const Command *command)
+{
+	switch (command->maincmd) {
+	case ADD_NODE:
+	case ADD_BLOCK:
+	case RM_NODE:
+	case RM_BLOCK:
+	case SYNC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* journal_cmd: Fails if the command could not be written, in which case it
+ * should not be run. Once a write has failed, every later one fails too, so
+ * that no command is ever written after a partly written one.
+ */
+int journal_cmd(Journal *journal, const Command *command)
+{
+	if (journal->fildes == -1)
+		return EXIT_SUCCESS;
+	pthread_mutex_lock(&journal->lock);
+	size_t num_written = journal->writer.num_written;
+	format_cmd(&journal->writer, command);
+	int result = flush_writer(&journal->writer);
+	journal->size += journal->writer.num_written - num_written;
+	if (!result) {
+		if (!journal->num_unsynced++) {
+			clock_gettime(CLOCK_MONOTONIC, &journal->first_unsynced);
+			pthread_cond_signal(&journal->has_unsynced);
+		}
+		if (journal->num_unsynced >= journal->max_unsynced
+		        || get_ms_since(&journal->first_unsynced) >= journal->max_delay_ms)
+			result = sync_unsynced(journal);
+	}
+	pthread_mutex_unlock(&journal->lock);
+	return result;
+}
+
+bool journal_is_full(const Journal *journal)
+{
+	return journal->fildes != -1 && journal->size > MIN_COMPACTION_SIZE
+	       && journal->size > journal->save_size;
+}
+
+/* reset_journal: Starts the journal anew, once the blockchain has been
+ * saved as checkpoint_id. Should that fail, the journal is closed, as the
+ * old one no longer applies.
+ */
+int reset_journal(Journal *journal, const char *checkpoint_id, size_t save_size)
+{
+	pthread_mutex_lock(&journal->lock);
+	if (journal->fildes != -1)
+		close(journal->fildes);
+	journal->fildes = -1;
+	journal->num_unsynced = 0;
+	journal->save_size = save_size;
+	int result = create_journal_file(journal, checkpoint_id);
+	pthread_mutex_unlock(&journal->lock);
+	return result;
+}
+
+void close_journal(Journal *journal)
+{
+	pthread_mutex_lock(&journal->lock);
+	journal->is_closing = true;
+	pthread_cond_signal(&journal->has_unsynced);
+	pthread_mutex_unlock(&journal->lock);
+	if (journal->has_flusher)
+		pthread_join(journal->flusher, NULL);
+	journal->has_flusher = false;
+	if (journal->fildes != -1) {
+		sync_unsynced(journal);
+		close(journal->fildes);
+		journal->fildes = -1;
+	}
+	free_writer(&journal->writer);
+	pthread_cond_destroy(&journal->has_unsynced);
+	pthread_mutex_destroy(&journal->lock);
+}
+
+/* get_header: The first line of a journal applying to checkpoint_id.
+ */
+void get_header(const char *checkpoint_id, char *header)
+{
+	snprintf(header, MAX_HEADER_SIZE, "my_blockchain journal %s\n", checkpoint_id);
+}
+
+/* replay_journal: Returns -1 if there is no journal applying to the save,
+ * in which case a new one should be created. The file is mapped privately,
+ * so that lines can be cut in place for parsing.
+ */
+int replay_journal(Journal *journal, const char *checkpoint_id, ReplayFn replay)
+{
+	char header[MAX_HEADER_SIZE];
+	get_header(checkpoint_id, header);
+	int fd = open(journal->pathname, O_RDWR);
+	if (fd == -1)
+		return -1;
+	struct stat status;
+	size_t header_size = strlen(header);
+	if (fstat(fd, &status) == -1 || (size_t) status.st_size < header_size) {
+		close(fd);
+		return -1;
+	}
+	size_t size = status.st_size;
+	char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED || memcmp(data, header, header_size)) {
+		if (data != MAP_FAILED)
+			munmap(data, size);
+		close(fd);
+		return -1;
+	}
+	char *line = data + header_size;
+	char *line_end;
+	while ((line_end = memchr(line, '\n', data + size - line))) {
+		*line_end = '\0';
+		replay(line);
+		line = line_end + 1;
+	}
+	size_t replayed_size = line - data;
+	munmap(data, size);
+	// The replayed commands are only in this file: if it cannot be added
+	// to, it is left as it is for the next session, and no journal is kept.
+	if ((replayed_size < size && ftruncate(fd, replayed_size) == -1)
+	        || lseek(fd, 0, SEEK_END) == -1) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	journal->fildes = fd;
+	journal->writer.fildes = fd;
+	journal->size = replayed_size;
+	return EXIT_SUCCESS;
+}
+
+/* create_journal_file: Writes the new journal under a temporary name, so
+ * that the old one is replaced whole.
+ */
+int create_journal_file(Journal *journal, const char *checkpoint_id)
+{
+	char header[MAX_HEADER_SIZE];
+	get_header(checkpoint_id, header);
+	char *temp_name = get_temp_name(journal->pathname);
+	if (!temp_name)
+		return EXIT_FAILURE;
+	int fd = open(temp_name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd == -1) {
+		free(temp_name);
+		return EXIT_FAILURE;
+	}
+	journal->writer.fildes = fd;
+	journal->writer.status = EXIT_SUCCESS;
+	write_bytes(&journal->writer, header, strlen(header));
+	if (flush_writer(&journal->writer) || fsync(fd) == -1
+	        || rename(temp_name, journal->pathname) == -1) {
+		close(fd);
+		unlink(temp_name);
+		free(temp_name);
+		journal->writer.fildes = -1;
+		return EXIT_FAILURE;
+	}
+	sync_directory(journal->pathname);
+	free(temp_name);
+	journal->fildes = fd;
+	journal->size = strlen(header);
+	return EXIT_SUCCESS;
+}
+
+void format_cmd(Writer *writer, const Command *command)
+{
+	switch (command->maincmd) {
+	case ADD_NODE:
+		write_bytes(writer, "add node", 8);
+		format_ids(writer, command->nidlist, 1);
+		break;
+	case ADD_BLOCK:
+		write_bytes(writer, "add block", 9);
+		format_ids(writer, command->bidlist, 1);
+		if (command->all)
+			write_bytes(writer, " *", 2);
+		else
+			format_ids(writer, command->nidlist, command->nidcount);
+		break;
+	case RM_NODE:
+		write_bytes(writer, "rm node", 7);
+		if (command->all)
+			write_bytes(writer, " *", 2);
+		else
+			format_ids(writer, command->nidlist, command->nidcount);
+		break;
+	case RM_BLOCK:
+		write_bytes(writer, "rm block", 8);
+		format_ids(writer, command->bidlist, command->bidcount);
+		break;
+	case SYNC:
+		write_bytes(writer, "sync", 4);
+		break;
+	default:
+		return;
+	}
+	write_char(writer, '\n');
+}
+
+void format_ids(Writer *writer, const unsigned int *ids, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		write_char(writer, ' ');
+		write_uint(writer, ids[i]);
+	}
+}
+
+long get_ms_since(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* sync_unsynced: Called with the lock held.
+ */
+int sync_unsynced(Journal *journal)
+{
+	if (!journal->num_unsynced)
+		return EXIT_SUCCESS;
+	journal->num_unsynced = 0;
+	if (fsync(journal->fildes) == -1) {
+		journal->writer.status = EXIT_FAILURE;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* run_flusher: Syncs the journal max_delay_ms after the first unsynced
+ * command, unless a later command has done so already.
+ */
+void *run_flusher(void *arg)
+{
+	Journal *journal = arg;
+	pthread_mutex_lock(&journal->lock);
+	while (!journal->is_closing) {
+		if (!journal->num_unsynced) {
+			pthread_cond_wait(&journal->has_unsynced, &journal->lock);
+			continue;
+		}
+		struct timespec deadline = journal->first_unsynced;
+		deadline.tv_sec += journal->max_delay_ms / 1000;
+		deadline.tv_nsec += journal->max_delay_ms % 1000 * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		if (pthread_cond_timedwait(&journal->has_unsynced, &journal->lock, &deadline) == ETIMEDOUT)
+			sync_unsynced(journal);
+	}
+	pthread_mutex_unlock(&journal->lock);
+	return NULL;
+}
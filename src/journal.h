@@ -0,0 +1,42 @@
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "commands.h"
+#include "utils/writer.h"
+
+typedef void (*ReplayFn)(char *line);
+
+/* Append-only log of the commands that changed the blockchain since it was
+ * last saved. See journal.c.
+ */
+typedef struct s_journal {
+	const char *pathname;
+	int fildes;
+	Writer writer;
+	size_t size;
+	size_t save_size;
+	size_t max_unsynced;
+	long max_delay_ms;
+	size_t num_unsynced;
+	struct timespec first_unsynced;
+	bool has_flusher;
+	pthread_t flusher;
+	pthread_mutex_t lock;
+	pthread_cond_t has_unsynced;
+	bool is_closing;
+} Journal;
+
+int open_journal(Journal *journal, const char *pathname, const char *checkpoint_id,
+                 size_t save_size, ReplayFn replay, size_t max_unsynced, long max_delay_ms);
+bool is_journaled(const Command *command);
+int journal_cmd(Journal *journal, const Command *command);
+bool journal_is_full(const Journal *journal);
+int reset_journal(Journal *journal, const char *checkpoint_id, size_t save_size);
+void close_journal(Journal *journal);
+
+#endif // _JOURNAL_H
@@ -2,12 +2,27 @@
 #include <stdlib.h>
 
 #include "commands.h"
+#include "options.h"
+#include "stats.h"
+#include "utils/mem.h"
 
-int my_blockchain()
+int my_blockchain(const Options *options)
 {
-	load_blockchain();
+	Blockchain *chain = load_blockchain(options);
+	if (!chain)
+		return EXIT_FAILURE;
+	BatchReport report = start_batch(options);
+	clear_stages();
+	Command next = create_cmd();
 	Command *command;
-	while ((command = get_cmd())) {
+	while ((command = get_cmd(options, &next))) {
+		int record_result = record_cmd(command);
+		end_stage(STAGE_JOURNAL);
+		if (record_result) {
+			count_cmd(&report, command);
+			record_stages(command->maincmd);
+			continue;
+		}
 		switch (command->maincmd) {
 		case UNDEFINED:
 			cmd_not_found();
@@ -15,34 +30,56 @@ int my_blockchain()
         case EMPTY:
 		    break;
         case ADD_NODE:
-			cmd_add_node(command);
+			cmd_add_node(chain, command);
 			break;
 		case ADD_BLOCK:
-			cmd_add_block(command);
+			cmd_add_block(chain, command);
 			break;
 		case RM_NODE:
-			cmd_rm_node(command);
+			cmd_rm_node(chain, command);
 			break;
 		case RM_BLOCK:
-			cmd_rm_block(command);
+			cmd_rm_block(chain, command);
 			break;
 		case LS:
-			cmd_ls(command);
+			cmd_ls(chain, command);
+			break;
+		case WHERE_BLOCK:
+			cmd_where_block(chain, command);
 			break;
 		case SYNC:
-			cmd_sync();
+			cmd_sync(chain);
+			break;
+		case STATS:
+			cmd_stats();
+			break;
+		case MEM:
+			cmd_mem(chain);
 			break;
 		case QUIT:
-			cmd_quit();
+			record_stages(QUIT);
+			cmd_quit(options);
 			goto quit;
 		}
+		end_stage(STAGE_EXECUTE);
+		count_cmd(&report, command);
+		compact_journal();
+		end_stage(STAGE_JOURNAL);
+		record_stages(command->maincmd);
 	}
 	quit:
 	free_cmd(command);
+	end_batch(&report);
 	return EXIT_SUCCESS;
 }
 
-int main()
+int main(int argc, char **argv)
 {	
-	return my_blockchain();
+	Options options;
+	if (parse_options(argc, argv, &options)) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+	set_mem_limit(options.mem_limit_mib << 20);
+	return my_blockchain(&options);
 }
@@ -0,0 +1,133 @@
+/* options.c: Parses the command line of my_blockchain. Options set how the
+ * program runs, never what the blockchain holds:
+ *
+ *     my_blockchain [-t threads] [-f text|binary] [-c] [-v] [-b] [-s file]
+ *                   [-m mib] [-g records] [-w ms]
+ *
+ * - -t sets the number of threads sync runs on (1 by default).
+ * - -f sets the format the blockchain is saved in when quitting (binary by
+ *   default). Either format is loaded, whichever this is.
+ * - -c saves incrementally (see checkpoint.c): only the nodes changed since
+ *   the last save are written, on top of a full binary save.
+ * - -v reports how many bytes were saved, and how fast, when quitting.
+ * - -b runs in batch mode, for commands piped in by a script: no prompt,
+ *   errors are buffered, the end of the input quits, and a summary of how
+ *   many commands ran, and how fast, is printed on exit. It is also the
+ *   default when STDIN is neither a terminal nor a socket, the only inputs
+ *   the prompt can be written back to.
+ * - -s writes the latency stats of the session (see stats.c) to that file,
+ *   as CSV, when quitting.
+ * - -m caps the memory the blockchain takes at that many MiB (see
+ *   utils/mem.c): commands that would need more fail with error 1 instead,
+ *   leaving the blockchain as it was. There is no cap by default.
+ * - -g and -w set the group commit of the journal (see journal.c): it is
+ *   synced to disk once that many commands are waiting (32 by default), or
+ *   that many milliseconds after the first (10 by default). -g 1 syncs
+ *   every command.
+ */
+
+#include <stdio.h>                 // For dprintf
+#include <stdlib.h>                // For EXIT_[X]
+#include <unistd.h>                // For STDERR_FILENO, isatty
+#include <sys/stat.h>              // For fstat
+
+#include "options.h"
+#include "utils/_stdlib.h"         // For _isnumeric, _strtol
+#include "utils/_string.h"         // For _strcmp, _strlen
+
+#define MAX_SYNC_THREADS 256
+#define DEFAULT_JOURNAL_RECORDS 32
+#define MAX_JOURNAL_RECORDS 100000
+#define DEFAULT_JOURNAL_DELAY_MS 10
+#define MAX_JOURNAL_DELAY_MS 60000
+#define MAX_MEM_LIMIT_MIB 1048576
+
+static int parse_count(const char *arg, size_t min, size_t max, size_t *count);
+static int parse_format(const char *arg, SaveFormat *format);
+static bool is_interactive(int fildes);
+
+int parse_options(int argc, char **argv, Options *options)
+{
+	options->sync_threads = 1;
+	options->save_format = SAVE_BINARY;
+	options->verbose = false;
+	options->incremental = false;
+	options->batch = false;
+	options->stats_pathname = NULL;
+	options->mem_limit_mib = 0;
+	options->journal_records = DEFAULT_JOURNAL_RECORDS;
+	options->journal_delay_ms = DEFAULT_JOURNAL_DELAY_MS;
+	for (int i = 1; i < argc; i++) {
+		if (!_strcmp(argv[i], "-t") && i + 1 < argc) {
+			if (parse_count(argv[++i], 1, MAX_SYNC_THREADS, &options->sync_threads))
+				return EXIT_FAILURE;
+		} else if (!_strcmp(argv[i], "-f") && i + 1 < argc) {
+			if (parse_format(argv[++i], &options->save_format))
+				return EXIT_FAILURE;
+		} else if (!_strcmp(argv[i], "-g") && i + 1 < argc) {
+			if (parse_count(argv[++i], 1, MAX_JOURNAL_RECORDS, &options->journal_records))
+				return EXIT_FAILURE;
+		} else if (!_strcmp(argv[i], "-w") && i + 1 < argc) {
+			if (parse_count(argv[++i], 0, MAX_JOURNAL_DELAY_MS, &options->journal_delay_ms))
+				return EXIT_FAILURE;
+		} else if (!_strcmp(argv[i], "-s") && i + 1 < argc) {
+			options->stats_pathname = argv[++i];
+		} else if (!_strcmp(argv[i], "-m") && i + 1 < argc) {
+			if (parse_count(argv[++i], 1, MAX_MEM_LIMIT_MIB, &options->mem_limit_mib))
+				return EXIT_FAILURE;
+		} else if (!_strcmp(argv[i], "-c")) {
+			options->incremental = true;
+		} else if (!_strcmp(argv[i], "-v")) {
+			options->verbose = true;
+		} else if (!_strcmp(argv[i], "-b")) {
+			options->batch = true;
+		} else {
+			return EXIT_FAILURE;
+		}
+	}
+	if (!is_interactive(STDIN_FILENO))
+		options->batch = true;
+	return EXIT_SUCCESS;
+}
+
+/* parse_count: Accepts decimal numbers from min to max, which must have
+ * fewer than 10 digits.
+ */
+int parse_count(const char *arg, size_t min, size_t max, size_t *count)
+{
+	if (!*arg || _strlen(arg) > 9 || !_isnumeric((char *) arg))
+		return EXIT_FAILURE;
+	long value = _strtol(arg, NULL, 10);
+	if (value < (long) min || value > (long) max)
+		return EXIT_FAILURE;
+	*count = value;
+	return EXIT_SUCCESS;
+}
+
+int parse_format(const char *arg, SaveFormat *format)
+{
+	if (!_strcmp(arg, "binary"))
+		*format = SAVE_BINARY;
+	else if (!_strcmp(arg, "text"))
+		*format = SAVE_TEXT;
+	else
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+/* is_interactive: Whether the prompt, which is written to STDIN, can reach
+ * whoever gives the commands: a terminal, or the other end of a socket.
+ */
+bool is_interactive(int fildes)
+{
+	if (isatty(fildes))
+		return true;
+	struct stat status;
+	return !fstat(fildes, &status) && S_ISSOCK(status.st_mode);
+}
+
+void print_usage()
+{
+	dprintf(STDERR_FILENO, "usage: my_blockchain [-t threads] [-f text|binary] [-c] [-v] [-b]\n"
+	        "                     [-s file] [-m mib] [-g records] [-w ms]\n");
+}
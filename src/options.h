@@ -0,0 +1,24 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "save.h"
+
+typedef struct s_options {
+	size_t sync_threads;
+	SaveFormat save_format;
+	bool verbose;
+	bool incremental;
+	bool batch;
+	const char *stats_pathname;
+	size_t mem_limit_mib;
+	size_t journal_records;
+	size_t journal_delay_ms;
+} Options;
+
+int parse_options(int argc, char **argv, Options *options);
+void print_usage();
+
+#endif
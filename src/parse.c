@@ -1,30 +1,41 @@
 /* parse.c contains logic for parsing input and "returning" a filled
  * struct Command. The most important function is parse_cmd(), which parses
  * the first token / word and then passes off the remaining parsing to one of
- * the parse_[X]_cmd() functions. parse_add_cmd() and parse_rm_cmd() are the only
- * ones that call parse_id_list(). The most complicated parse_[X] function
- * is parse_id_list(), which combines various functionality into one function.
- * It's currently quite messy, but I made a judgement to keep it all here
- * for ease of reference vs modularizing and spreading it out over various 
- * functions, especially because I don't expect we need to reuse it.
+ * the parse_[X]_cmd() functions. parse_add_cmd(), parse_rm_cmd() and
+ * parse_where_cmd() are the only ones that call parse_id_list(), which reads
+ * the ids into lists that Command keeps from one command to the next.
+ *
+ * Parsing is a single pass over the line, in place: next_token() ends each
+ * token with a null where its space was, so nothing is copied, and the ids
+ * are read straight from the tokens by parse_uint32().
  *
  * parse_cmd()  ->  parse_add_cmd()  ->  parse_id_list()
  *              ->  parse_rm_cmd()   ->  parse_id_list()
- *              ->  parse_ls_cmd()
+ *              ->  parse_ls_cmd()    ->  parse_nid_range()
+ *              ->  parse_where_cmd() ->  parse_id_list()
  *              ->  parse_sync_cmd()
  *              ->  parse_quit_cmd()
+ *              ->  parse_stats_cmd()
+ *              ->  parse_mem_cmd()
  *
  */
 
-#include <stdio.h>                 // For printf
-#include <stdlib.h>                // For free
+#include <stdlib.h>                // For EXIT_[X]
+#include <string.h>                // For strcspn, strspn, memchr
 
 #include "parse.h"
-#include "utils/_string.h"         // For _strcmp, _strsep
-#include "utils/_stdlib.h"         // For _strtol, _isnumeric
+#include "utils/_string.h"         // For _strcmp
+#include "utils/decimal.h"         // For parse_uint32
+#include "utils/mem.h"             // For mem_realloc
+
+#define MIN_ID_LIST_CAPACITY 16
 
 /* Declare parse_id_list here so parse_add_cmd and parse_rm_cmd can use it */
-static void parse_id_list(Command *command, char **line, int n, char type);
+static void parse_id_list(Command *command, char **line, size_t n, char type);
+static char *next_token(char **line, size_t *length);
+static int reserve_ids(unsigned int **list, size_t *capacity, size_t count);
+static int parse_nid_range(Command *command, char *token, size_t length);
+static int parse_limit(char **line, size_t *limit);
 
 static void parse_empty_cmd(Command *command)
 {
@@ -37,8 +48,8 @@ static void parse_empty_cmd(Command *command)
  */
 static void parse_add_cmd(Command *command, char **line)
 {
-	char delim = ' ';
-	char *token = _strsep(line, &delim);
+	size_t length;
+	char *token = next_token(line, &length);
 	if (!token) return;
 	if (!_strcmp("node", token)) {
 		command->maincmd = ADD_NODE;
@@ -63,8 +74,8 @@ static void parse_add_cmd(Command *command, char **line)
  */
 static void parse_rm_cmd(Command *command, char **line)
 {
-	char delim = ' ';
-	char *token = _strsep(line, &delim);
+	size_t length;
+	char *token = next_token(line, &length);
 	if (!token) return;
 	if (!_strcmp("node", token)) {
 		command->maincmd = RM_NODE;
@@ -82,15 +93,16 @@ static void parse_rm_cmd(Command *command, char **line)
 	return;
 }
 
-/* parse_id_list: Currently a messy GOD function. Should probably be
- * refactored into multiple smaller modules. 
- *
- * This function is required for parse_add_cmd and parse_rm_cmd.
+/* parse_id_list: This function is required for parse_add_cmd, parse_rm_cmd
+ * and parse_where_cmd.
  * It takes the remaining tokens, which are supposed to be one or more
- * bid's or nid's, and adds them as a malloc'd array to Command. The
+ * bid's or nid's, and adds them to the [x]idlist of Command, growing it
+ * if it is too short. The list is kept for the next command, so a session
+ * only allocates when a command has more ids than any before it. The
  * function also updates .[x]idcount and/or .all if necessary.
  *
- * Because we allocate memory here, we have to free it later.
+ * A token that is not * nor an id that fits in an unsigned int makes the
+ * command UNDEFINED.
  *
  * Parameters
  * ----------
@@ -101,67 +113,148 @@ static void parse_rm_cmd(Command *command, char **line)
  *        to update.
  *
  */
-static void parse_id_list(Command *command, char **line, int n, char type) 
+static void parse_id_list(Command *command, char **line, size_t n, char type)
 {
-	char delim = ' ';
-	unsigned int **xidlist = NULL;
-	// Determine which list we're populating
-	if (type == 'n') {
-		xidlist = &command->nidlist;
-	} else if (type == 'b') {
+	unsigned int **xidlist = &command->nidlist;
+	size_t *xidcapacity = &command->nidcapacity;
+	size_t *xidcount = &command->nidcount;
+	if (type == 'b') {
 		xidlist = &command->bidlist;
+		xidcapacity = &command->bidcapacity;
+		xidcount = &command->bidcount;
 	}
-	// Allocate exact amount of memory to .xidlist
-	int tokencount = 0;
-	char cpyline[_strlen(*line) + 1];
-	_strcpy(cpyline, *line);
-	char *cpyptr = cpyline;
-	while (_strsep(&cpyptr, &delim)) {
-		tokencount++;
-	}
-	if (!tokencount) return;
-	*xidlist = malloc(sizeof(unsigned int) * tokencount);
 	// Get tokens and add to .xidlist up to a maximum of n
 	// (unless n = 0 in which case no limit)
 	char *token;
-	size_t xidcount = 0;
-	int max = (n == 0) ? tokencount : n;
-	for (int i = 0; i < tokencount && i < max; i++) {
-		token = _strsep(line, &delim);
+	size_t length;
+	size_t count = 0;
+	for (size_t i = 0; (!n || i < n) && (token = next_token(line, &length)); i++) {
 		// If any tokens are *, we set all flag and continue
-		if (!_strcmp("*", token)) {
+		if (length == 1 && *token == '*') {
 			command->all = true;
 			continue;
 		}
 		// If token isn't a number (and isn't *), bad command
-		if (!_isnumeric(token)) {
+		if (reserve_ids(xidlist, xidcapacity, count + 1)
+		    || parse_uint32(token, length, *xidlist + count)) {
 			command->maincmd = UNDEFINED;
 			return;
 		}
-		*(*xidlist + xidcount) = strtol(token, NULL, 10);
-		xidcount++;
+		count++;
 	}
-	if (type == 'n') {
-		command->nidcount = xidcount;
-	} else if (type == 'b') {
-		command->bidcount = xidcount;
+	*xidcount = count;
+}
+
+/* reserve_ids: Grows list, by doubling, until it can hold count ids. */
+static int reserve_ids(unsigned int **list, size_t *capacity, size_t count)
+{
+	if (count <= *capacity) return EXIT_SUCCESS;
+	size_t new_capacity = *capacity ? *capacity : MIN_ID_LIST_CAPACITY;
+	while (new_capacity < count) {
+		new_capacity *= 2;
 	}
-	return;
+	unsigned int *new_list = mem_realloc(MEM_PARSE, *list, sizeof(unsigned int) * *capacity,
+	                                     sizeof(unsigned int) * new_capacity);
+	if (!new_list) return EXIT_FAILURE;
+	*list = new_list;
+	*capacity = new_capacity;
+	return EXIT_SUCCESS;
+}
 
+/* next_token: Splits the next token off line as _strsep() does: the space
+ * after it becomes a null, the spaces that follow are skipped, and NULL is
+ * returned once line is empty. Also gives the token's length, so that it
+ * need not be measured again.
+ */
+static char *next_token(char **line, size_t *length)
+{
+	char *token = *line;
+	if (!*token) return NULL;
+	*length = strcspn(token, " ");
+	*line = token + *length;
+	if (**line) {
+		*(*line)++ = '\0';
+		*line += strspn(*line, " ");
+	}
+	return token;
 }
 
-/* parse_ls_cmd: Needs to check if there is an '-l' flag. 
- * Right now only checks second token.
+/* parse_ls_cmd: Accounts for:
+ * ls [-l] [-c] [-n nodes] [-b blocks] [nid | nid-nid]
+ * in any order. -c only counts the nodes and blocks, -n and -b cap the
+ * number of nodes listed and of blocks listed per node, and the nid or
+ * range narrows the listing to the nodes with those ids.
  */
 static void parse_ls_cmd(Command *command, char **line)
 {
 	command->maincmd = LS;
-	char delim = ' ';
-	char *token = _strsep(line, &delim);
-	// If we don't include this check, _strcmp will error if token is NULL.
+	size_t length;
+	char *token;
+	while ((token = next_token(line, &length))) {
+		int result = EXIT_SUCCESS;
+		if (!_strcmp("-l", token)) {
+			command->lflag = true;
+		} else if (!_strcmp("-c", token)) {
+			command->cflag = true;
+		} else if (!_strcmp("-n", token)) {
+			result = parse_limit(line, &command->maxnodes);
+		} else if (!_strcmp("-b", token)) {
+			result = parse_limit(line, &command->maxblocks);
+		} else {
+			result = parse_nid_range(command, token, length);
+		}
+		if (result) {
+			command->maincmd = UNDEFINED;
+			return;
+		}
+	}
+}
+
+/* parse_nid_range: Reads either a single nid or two, lowest first, joined
+ * by a '-'.
+ */
+static int parse_nid_range(Command *command, char *token, size_t length)
+{
+	char *dash = memchr(token, '-', length);
+	if (!dash) {
+		if (parse_uint32(token, length, &command->nidmin))
+			return EXIT_FAILURE;
+		command->nidmax = command->nidmin;
+		return EXIT_SUCCESS;
+	}
+	if (parse_uint32(token, dash - token, &command->nidmin)
+	    || parse_uint32(dash + 1, length - (dash + 1 - token), &command->nidmax)
+	    || command->nidmin > command->nidmax)
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+/* parse_limit: Reads the token after an -n or -b. */
+static int parse_limit(char **line, size_t *limit)
+{
+	size_t length;
+	char *token = next_token(line, &length);
+	unsigned int value;
+	if (!token || parse_uint32(token, length, &value))
+		return EXIT_FAILURE;
+	*limit = value;
+	return EXIT_SUCCESS;
+}
+
+/* parse_where_cmd: Accounts for:
+ * where block bid
+ */
+static void parse_where_cmd(Command *command, char **line)
+{
+	size_t length;
+	char *token = next_token(line, &length);
 	if (!token) return;
-	if (!_strcmp("-l", token)) {
-		command->lflag = true;
+	if (!_strcmp("block", token)) {
+		command->maincmd = WHERE_BLOCK;
+		parse_id_list(command, line, 1, 'b');
+		if (command->bidcount != 1) {
+			command->maincmd = UNDEFINED;
+		}
 	}
 	return;
 }
@@ -176,13 +269,23 @@ static void parse_quit_cmd(Command *command)
 	command->maincmd = QUIT;
 }
 
+static void parse_stats_cmd(Command *command)
+{
+	command->maincmd = STATS;
+}
+
+static void parse_mem_cmd(Command *command)
+{
+	command->maincmd = MEM;
+}
+
 /* parse_cmd: This function parses the first token and then passes off
  * remaining parsing to one of the parse_[X]_cmd functions. 
  */
 void parse_cmd(Command *command, char *line)
 {
-	char delim = ' ';
-	char *token = _strsep(&line, &delim);
+	size_t length;
+	char *token = next_token(&line, &length);
 	if (!token) {
 	    parse_empty_cmd(command);
 	} else if (!_strcmp("add", token)) {
@@ -191,9 +294,15 @@ void parse_cmd(Command *command, char *line)
 		parse_rm_cmd(command, &line);
 	} else if (!_strcmp("ls", token)) {
 		parse_ls_cmd(command, &line);
+	} else if (!_strcmp("where", token)) {
+		parse_where_cmd(command, &line);
 	} else if (!_strcmp("sync", token)) {
 		parse_sync_cmd(command);
 	} else if (!_strcmp("quit", token)) {
 		parse_quit_cmd(command);
+	} else if (!_strcmp("stats", token)) {
+		parse_stats_cmd(command);
+	} else if (!_strcmp("mem", token)) {
+		parse_mem_cmd(command);
 	} 	
 }
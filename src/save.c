@@ -3,11 +3,25 @@
  *
  * A few "design" decisions: 
  *
- * - save() will serialize blockchain in the following format:
+ * - save() will serialize blockchain as a binary snapshot (see
+ *   blockchain/snapshot.c), or, for export, in the following text format:
  *          [nid]:[bid],[bid],...
  *          [nid]:[bid],[bid],...
  *          ...
  *
+ * - save() also writes deltas, holding only what changed since the last
+ *   save, which checkpoint.c stacks on a full snapshot; save_merged()
+ *   folds them back into one.
+ *
+ * - save() never overwrites the previous save in place: it writes a
+ *   temporary file through one large buffer, syncs it to disk, then
+ *   renames it over the old one, so that a crash leaves either save whole.
+ *
+ * - load() detects the format. Files are mapped into memory and read in
+ *   place: snapshots as they are, text files split into ranges of lines
+ *   parsed on several threads (see blockchain/text.c). Only snapshots keep
+ *   the sync state: loading a text file rebuilds it from the blocks.
+ *
  * - load() will fail on 3 conditions: 1) duplicate blocks, 2) duplicate
  *   nodes, 3) failure to open file. The first two conditions indicates
  *   that the file is corrupted while the latter indicates that no file 
@@ -15,101 +29,208 @@
  *
  */
 
-#include <stdio.h>                 // For dprintf
+#include <stdio.h>                 // For rename
 #include <stdlib.h>                // For EXIT_[X], free
+#include <string.h>                // For memcpy, strrchr, strdup
+#include <time.h>                  // For clock_gettime
 #include <fcntl.h>                 // For open
-#include <unistd.h>                // For STDIN
-#include <sys/stat.h>              // For fchmod
+#include <unistd.h>                // For fsync, close, unlink
+#include <sys/stat.h>              // For fchmod, fstat
+#include <sys/mman.h>              // For mmap
 
+#include "save.h"
 #include "blockchain/blockchain_public.h"
-#include "utils/_string.h"         // For _strsep
-#include "utils/_stdlib.h"         // For _strtol
-#include "utils/_readline.h"
+#include "blockchain/snapshot.h"
+#include "blockchain/text.h"
+#include "utils/_string.h"         // For _strlen
+#include "utils/writer.h"
 
-static int save_block(int fildes, Block *block) 
-{
-	return dprintf(fildes, "%d", block->id);
-}
+#define TEMP_SUFFIX ".tmp"
 
-static int save_node(int fildes, Node *node)
+static void save_node(Writer *writer, Node *node)
 {
-	int print_count = 0;
-	print_count += dprintf(fildes, "%d:", node->id);
-	Block *current_block = node->head;
+	write_uint(writer, node->id);
+	write_char(writer, ':');
+	Block *current_block = first_block(node);
 	while (current_block) {
-		print_count += save_block(fildes, current_block);
-		print_count += dprintf(fildes, ",");
-		current_block = current_block->next;
+		write_uint(writer, current_block->id);
+		write_char(writer, ',');
+		current_block = next_block(node, current_block);
 	}
-	return print_count;
 }
 
-static int save_blockchain(int fildes, Node *head_node) 
+static int save_blockchain(Writer *writer, Node *head_node)
 {
-	int print_count = 0;
 	Node *current_node = head_node;
 	while (current_node) {
-		print_count += save_node(fildes, current_node);
-		print_count += dprintf(fildes, "\n");
+		save_node(writer, current_node);
+		write_char(writer, '\n');
 		current_node = current_node->next;
 	}
-	return print_count;
+	return writer->status;
 }
 
-int save(const char *filename, Node *head_node)
+/* get_temp_name: The file is written under this name, next to the file it
+ * replaces, and only renamed once complete.
+ */
+char *get_temp_name(const char *filename)
 {
-	// Give file 744 righs (rwxr--r--).
-	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC,
-	                        S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IROTH);
-	if (fd == -1) return fd;
-	return save_blockchain(fd, head_node);
+	size_t length = _strlen(filename);
+	char *temp_name = malloc(length + sizeof (TEMP_SUFFIX));
+	if (!temp_name) return NULL;
+	memcpy(temp_name, filename, length);
+	memcpy(temp_name + length, TEMP_SUFFIX, sizeof (TEMP_SUFFIX));
+	return temp_name;
 }
 
-static Block *load_block(unsigned int bid, Node *node)
+/* sync_directory: Makes the rename of a file in the directory durable.
+ */
+int sync_directory(const char *filename)
 {
-	if (has_block_with_id(bid, node)) return NULL;
-	Block *block = new_block(bid);
-	add_block(block, node);
-	return block;
+	const char *slash = strrchr(filename, '/');
+	char *dirname = slash ? strndup(filename, slash - filename + 1) : strdup(".");
+	if (!dirname) return EXIT_FAILURE;
+	int fd = open(dirname, O_RDONLY);
+	free(dirname);
+	if (fd == -1) return EXIT_FAILURE;
+	int result = fsync(fd) == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+	close(fd);
+	return result;
 }
 
-static Node *load_node(char *nidline)
+/* SaveContent: What save() writes, as given to write_content().
+ */
+typedef struct s_save_content {
+	const Blockchain *chain;
+	SaveFormat format;
+	const SnapshotInfo *info;
+	const unsigned char *const *snapshots;
+	const size_t *sizes;
+	size_t num_snapshots;
+} SaveContent;
+
+static int write_content(Writer *writer, const SaveContent *content)
 {
-	// First token: nid.
-	char delim = ':';
-	char *token = _strsep(&nidline, &delim);
-	unsigned int nid = _strtol(token, NULL, 10);
-	if (has_node_with_id(nid)) return NULL;
-	Node *node = new_node(nid);
+	if (content->snapshots)
+		return merge_snapshots(writer, content->snapshots, content->sizes,
+		                       content->num_snapshots, content->info);
+	if (content->format == SAVE_TEXT)
+		return save_blockchain(writer, get_nodes(content->chain));
+	return write_snapshot(writer, content->chain, content->info);
+}
 
-	// Remaining tokens: bids.
-	delim = ',';
-	while ((token = _strsep(&nidline, &delim)) != NULL) {
-		unsigned int bid = _strtol(token, NULL, 10);
-		Block *curr_block;
-		if ((curr_block = load_block(bid, node)) == NULL) return NULL;
-	}
-	
-	return node;
+static int write_file(int fildes, const SaveContent *content, size_t *num_bytes)
+{
+	Writer writer;
+	if (create_writer(&writer, fildes)) return EXIT_FAILURE;
+	int result = write_content(&writer, content);
+	if (flush_writer(&writer))
+		result = EXIT_FAILURE;
+	*num_bytes = writer.num_written;
+	free_writer(&writer);
+	return result;
 }
 
-static int load_blockchain(int fildes)
+static double get_seconds_since(const struct timespec *start)
 {
-	char *line;
-	Node *node;
-	while ((line = _readline(fildes)) != NULL) {
-		if ((node = load_node(line)) == NULL) return EXIT_FAILURE;
-		add_node(node);
-		free(line);
-		line = NULL;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int write_atomically(const char *filename, const SaveContent *content, SaveReport *report)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	report->num_bytes = 0;
+	char *temp_name = get_temp_name(filename);
+	if (!temp_name) return EXIT_FAILURE;
+	// Give file 744 righs (rwxr--r--).
+	int fd = open(temp_name, O_WRONLY | O_CREAT | O_TRUNC,
+	                         S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IROTH);
+	if (fd == -1) {
+		free(temp_name);
+		return EXIT_FAILURE;
 	}
-	update_sync_state();
-	return EXIT_SUCCESS;
+	int result = write_file(fd, content, &report->num_bytes);
+	if (!result && fsync(fd) == -1)
+		result = EXIT_FAILURE;
+	if (close(fd) == -1)
+		result = EXIT_FAILURE;
+	if (!result && rename(temp_name, filename) == -1)
+		result = EXIT_FAILURE;
+	if (result)
+		unlink(temp_name);
+	else
+		sync_directory(filename);
+	free(temp_name);
+	report->seconds = get_seconds_since(&start);
+	return result;
+}
+
+/* save: info says where a binary snapshot stands (see snapshot.h); for a
+ * delta, only what changed since the blockchain was last saved is written.
+ */
+int save(const char *filename, const Blockchain *chain, SaveFormat format, const SnapshotInfo *info,
+         SaveReport *report)
+{
+	SaveContent content = {
+		.chain = chain,
+		.format = format,
+		.info = info,
+		.snapshots = NULL,
+		.sizes = NULL,
+		.num_snapshots = 0,
+	};
+	return write_atomically(filename, &content, report);
 }
 
-int load(char *filename)
+/* save_merged: Saves the full snapshot that the given snapshots, a full
+ * one then deltas, add up to, as info. Never looks at the blockchain, so
+ * that it may run alongside changes to it.
+ */
+int save_merged(const char *filename, const unsigned char *const *snapshots,
+                const size_t *sizes, size_t num_snapshots, const SnapshotInfo *info,
+                SaveReport *report)
 {
+	SaveContent content = {
+		.chain = NULL,
+		.format = SAVE_BINARY,
+		.info = info,
+		.snapshots = snapshots,
+		.sizes = sizes,
+		.num_snapshots = num_snapshots,
+	};
+	return write_atomically(filename, &content, report);
+}
+
+/* load: Sets info to where the snapshot loaded stands, or to lineage 0
+ * for a text file. A delta cannot be loaded on its own.
+ */
+int load(char *filename, Blockchain *chain, SnapshotInfo *info)
+{
+	info->lineage = 0;
+	info->sequence = 0;
+	info->is_delta = false;
 	int fd = open(filename, O_RDONLY);
 	if (fd == -1) return EXIT_FAILURE;
-	return load_blockchain(fd);
+	struct stat status;
+	if (fstat(fd, &status) == -1) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	// An empty file is an empty text save, which cannot be mapped.
+	size_t size = status.st_size;
+	unsigned char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (data == MAP_FAILED) return EXIT_FAILURE;
+	int result;
+	if (is_snapshot(data, size))
+		result = read_snapshot_info(data, size, info) || info->is_delta
+		         || read_snapshot(chain, data, size);
+	else
+		result = read_text(chain, (const char *) data, size);
+	if (data)
+		munmap(data, size);
+	return result;
 }
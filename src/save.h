@@ -2,8 +2,25 @@
 #define _SAVE_H
 
 #include "blockchain/blockchain_public.h"
+#include "blockchain/snapshot.h"
 
-int save(const char *filename, Node *head_node);
-int load(char *filename);
+typedef enum e_save_format {
+	SAVE_BINARY,
+	SAVE_TEXT
+} SaveFormat;
+
+typedef struct s_save_report {
+	size_t num_bytes;
+	double seconds;
+} SaveReport;
+
+int save(const char *filename, const Blockchain *chain, SaveFormat format, const SnapshotInfo *info,
+         SaveReport *report);
+int save_merged(const char *filename, const unsigned char *const *snapshots,
+                const size_t *sizes, size_t num_snapshots, const SnapshotInfo *info,
+                SaveReport *report);
+int load(char *filename, Blockchain *chain, SnapshotInfo *info);
+char *get_temp_name(const char *filename);
+int sync_directory(const char *filename);
 
 #endif // _SAVE_H
@@ -0,0 +1,190 @@
+/* stats.c: Latency histograms of every stage of every kind of command,
+ * for the stats command and the -s option, and the memory report of the
+ * mem command (see utils/mem.c).
+ *
+ * The stages of a command run back to back, so they are timed as laps:
+ * end_stage() ends one and starts the next, with a single reading of the
+ * clock, and start_stage() starts one after a pause, such as waiting for
+ * input. Their times add up until record_stages() files them under the
+ * command, once it is known and done. A stage may run several times for
+ * one command, or not at all, in which case it is not recorded:
+ *
+ * - prompt: print_prompt(), which counts the nodes and checks whether
+ *   they are synced. Not in batch mode.
+ * - parse: parse_cmd().
+ * - journal: writing the command to the journal, then compacting it if
+ *   full (see journal.c).
+ * - execute: running the command, less its sync state updates.
+ * - sync state: the update_sync_state() calls the command made.
+ *
+ * Reading the clock costs some tens of nanoseconds, and recording a
+ * stage a few more (see histogram.h), under half a microsecond per
+ * command in all, so the stats are always kept.
+ */
+
+#include <fcntl.h>                 // For open
+#include <stdarg.h>                // For va_list
+#include <stdbool.h>
+#include <stdio.h>                 // For snprintf
+#include <stdlib.h>                // For EXIT_[X]
+#include <time.h>                  // For clock_gettime
+#include <unistd.h>                // For close
+
+#include "stats.h"
+#include "utils/histogram.h"
+#include "utils/mem.h"
+
+#define MAX_ROW_SIZE 128
+
+static const char *CMD_NAMES[NUM_MAIN_CMDS] = {
+	"undefined", "empty", "add node", "add block", "rm node", "rm block",
+	"ls", "where block", "sync", "quit", "stats", "mem"
+};
+
+static const char *STAGE_NAMES[NUM_STAGES] = {
+	"prompt", "parse", "journal", "execute", "sync state"
+};
+
+static Histogram histograms[NUM_MAIN_CMDS][NUM_STAGES];
+static unsigned long stage_times[NUM_STAGES];
+static bool stage_has_run[NUM_STAGES];
+static unsigned long stage_start;
+
+static unsigned long get_time_ns();
+static void write_row(Writer *writer, const char *format, ...);
+
+void start_stage()
+{
+	stage_start = get_time_ns();
+}
+
+void end_stage(Stage stage)
+{
+	unsigned long now = get_time_ns();
+	stage_times[stage] += now - stage_start;
+	stage_has_run[stage] = true;
+	stage_start = now;
+}
+
+/* record_stages: Files the stages timed since the last call under
+ * maincmd.
+ */
+void record_stages(MainCmd maincmd)
+{
+	for (int stage = 0; stage < NUM_STAGES; stage++) {
+		if (stage_has_run[stage])
+			record_value(&histograms[maincmd][stage], stage_times[stage]);
+	}
+	clear_stages();
+}
+
+/* clear_stages: Forgets the stages timed since the last record_stages(),
+ * such as those of the commands replayed from the journal.
+ */
+void clear_stages()
+{
+	for (int stage = 0; stage < NUM_STAGES; stage++) {
+		stage_times[stage] = 0;
+		stage_has_run[stage] = false;
+	}
+}
+
+/* write_stats: Writes a table of how many times each stage of each
+ * command ran, and its median, 99th percentile and slowest times, in
+ * microseconds.
+ */
+void write_stats(Writer *writer)
+{
+	write_row(writer, "%-12s%-12s%10s%12s%12s%12s\n", "command", "stage", "count",
+	          "p50_us", "p99_us", "max_us");
+	for (int maincmd = 0; maincmd < NUM_MAIN_CMDS; maincmd++) {
+		for (int stage = 0; stage < NUM_STAGES; stage++) {
+			const Histogram *histogram = &histograms[maincmd][stage];
+			if (!histogram->count)
+				continue;
+			write_row(writer, "%-12s%-12s%10lu%12.1f%12.1f%12.1f\n", CMD_NAMES[maincmd],
+			          STAGE_NAMES[stage], histogram->count,
+			          get_percentile(histogram, 50) / 1e3,
+			          get_percentile(histogram, 99) / 1e3, histogram->max / 1e3);
+		}
+	}
+}
+
+/* dump_stats: Writes the stats to pathname as CSV, in nanoseconds, with
+ * more percentiles than write_stats().
+ */
+int dump_stats(const char *pathname)
+{
+	int fildes = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fildes == -1)
+		return EXIT_FAILURE;
+	Writer writer;
+	if (create_writer(&writer, fildes)) {
+		close(fildes);
+		return EXIT_FAILURE;
+	}
+	write_row(&writer, "command,stage,count,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+	for (int maincmd = 0; maincmd < NUM_MAIN_CMDS; maincmd++) {
+		for (int stage = 0; stage < NUM_STAGES; stage++) {
+			const Histogram *histogram = &histograms[maincmd][stage];
+			if (!histogram->count)
+				continue;
+			write_row(&writer, "%s,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", CMD_NAMES[maincmd],
+			          STAGE_NAMES[stage], histogram->count,
+			          histogram->total / histogram->count,
+			          get_percentile(histogram, 50), get_percentile(histogram, 90),
+			          get_percentile(histogram, 99), get_percentile(histogram, 99.9),
+			          histogram->max);
+		}
+	}
+	int result = flush_writer(&writer);
+	free_writer(&writer);
+	if (close(fildes))
+		result = EXIT_FAILURE;
+	return result;
+}
+
+/* write_mem_stats: Writes a table of the live and peak bytes of each kind
+ * of memory, the limit, how many charges it rejected, and what the nodes
+ * and blocks take on average: indexes, nodes and blocks, over num_nodes
+ * nodes holding num_blocks blocks.
+ */
+void write_mem_stats(Writer *writer, size_t num_nodes, size_t num_blocks)
+{
+	write_row(writer, "%-12s%16s%16s\n", "kind", "live_bytes", "peak_bytes");
+	size_t stored = 0;
+	for (int kind = 0; kind < NUM_MEM_KINDS; kind++) {
+		MemStats stats = get_mem_stats(kind);
+		write_row(writer, "%-12s%16zu%16zu\n", get_mem_kind_name(kind), stats.live, stats.peak);
+		if (kind == MEM_INDEXES || kind == MEM_NODES || kind == MEM_BLOCKS)
+			stored += stats.live;
+	}
+	MemStats total = get_total_mem_stats();
+	write_row(writer, "%-12s%16zu%16zu\n", "total", total.live, total.peak);
+	if (get_mem_limit())
+		write_row(writer, "limit %zu bytes, %zu rejected\n", get_mem_limit(),
+		          get_num_mem_rejections());
+	else
+		write_row(writer, "no limit\n");
+	write_row(writer, "%zu nodes, %zu blocks, %.1f bytes per node, %.1f bytes per block\n",
+	          num_nodes, num_blocks, num_nodes ? (double) stored / num_nodes : 0.0,
+	          num_blocks ? (double) stored / num_blocks : 0.0);
+}
+
+unsigned long get_time_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+void write_row(Writer *writer, const char *format, ...)
+{
+	char row[MAX_ROW_SIZE];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(row, MAX_ROW_SIZE, format, args);
+	va_end(args);
+	if (length > 0)
+		write_bytes(writer, row, length < MAX_ROW_SIZE ? length : MAX_ROW_SIZE - 1);
+}
@@ -0,0 +1,27 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include "commands.h"
+#include "utils/writer.h"
+
+#define NUM_MAIN_CMDS (MEM + 1)
+
+/* The stages of a command that are timed. See stats.c. */
+typedef enum e_stage {
+	STAGE_PROMPT,
+	STAGE_PARSE,
+	STAGE_JOURNAL,
+	STAGE_EXECUTE,
+	STAGE_SYNC_STATE,
+	NUM_STAGES
+} Stage;
+
+void start_stage();
+void end_stage(Stage stage);
+void record_stages(MainCmd maincmd);
+void clear_stages();
+void write_stats(Writer *writer);
+int dump_stats(const char *pathname);
+void write_mem_stats(Writer *writer, size_t num_nodes, size_t num_blocks);
+
+#endif // _STATS_H
@@ -1,109 +1,149 @@
+#include <stdbool.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <stddef.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 
-#define READLINE_READ_SIZE 512
-#define NEWLINE '\n'
+#include "_readline.h"
+#include "mem.h"
 
-typedef unsigned short ushort;
-typedef struct {
-    ushort offset;
-    ushort length;
-    char array[BUFSIZ];
-} ReadBuffer;
+#define READLINE_READ_SIZE 65536
+#define NEWLINE '\n'
 
-static ushort fill(ReadBuffer* buffer, int fd);
-static void reset_index(ReadBuffer* buffer);
-static ushort newline_index(ReadBuffer* buffer, int fd);
-static ushort scan_until_newline(const ReadBuffer* buffer, ushort i);
-static void add_newline(ReadBuffer* buffer, ushort i);
-static char* pop(ReadBuffer* buffer, ushort n);
-static void offset(ReadBuffer* buffer, ushort n);
+static size_t fill(ReadBuffer* buffer, int fd);
+static int reserve(ReadBuffer* buffer, size_t capacity);
+static char* pop(ReadBuffer* buffer, size_t n, size_t* length);
 
-char* _readline(int fd)
+/* create_read_buffer: Returns an empty buffer, which allocates nothing
+ * until first read through. Each file read line by line needs its own.
+ */
+ReadBuffer create_read_buffer()
 {
-    static ReadBuffer buffer = {
+    ReadBuffer buffer = {
+            .array = NULL,
+            .capacity = 0,
             .offset = 0,
             .length = 0,
-            .array = {0}
+            .scanned = 0
     };
-    if (!buffer.length && !fill(&buffer, fd))
-    {
-        return NULL;
-    }
-    return pop(&buffer, newline_index(&buffer, fd));
-}
-
-ushort fill(ReadBuffer* buffer, int fd)
-{
-    reset_index(buffer);
-    ssize_t s_chars_r = read(fd, &buffer->array[buffer->length], READLINE_READ_SIZE);
-    ushort chars_read = (ushort) s_chars_r;
-    if (s_chars_r == -1) return 0;
-    buffer->length += chars_read;
-    buffer->array[buffer->length] = 0;
-    return chars_read;
+    return buffer;
 }
 
-void reset_index(ReadBuffer* buffer)
+/* _readline: Returns the next line read from fd through buffer, without
+ * its newline, in memory of its own, or NULL once there is nothing left to
+ * read.
+ */
+char* _readline(ReadBuffer* buffer, int fd)
 {
-    ushort i;
-    for (i = 0; i < buffer->length; i++)
+    size_t length;
+    const char* view = _readline_view(buffer, fd, &length);
+    if (!view)
+    {
+        return NULL;
+    }
+    char* line = malloc(length + 1);
+    if (line)
     {
-        buffer->array[i] = buffer->array[i + buffer->offset];
+        memcpy(line, view, length + 1);
     }
-    buffer->offset = 0;
+    return line;
 }
 
-ushort newline_index(ReadBuffer* buffer, int fd)
+/* _readline_view: Same as _readline(), except that the line returned, null
+ * terminated, is in the reader's buffer: it stays valid, and may be
+ * modified in place, until the next call. The last line need not end with
+ * a newline.
+ */
+char* _readline_view(ReadBuffer* buffer, int fd, size_t* length)
 {
-    ushort i = scan_until_newline(buffer, 0);
-    char last = buffer->array[buffer->offset + i];
-    while (last != NEWLINE)
+    while (true)
     {
+        char* start = &buffer->array[buffer->offset];
+        char* newline = buffer->length > buffer->scanned
+                        ? memchr(start + buffer->scanned, NEWLINE, buffer->length - buffer->scanned)
+                        : NULL;
+        if (newline)
+        {
+            return pop(buffer, newline - start, length);
+        }
+        buffer->scanned = buffer->length;
         if (!fill(buffer, fd))
         {
-            add_newline(buffer, i);
-            break;
+            return buffer->length ? pop(buffer, buffer->length, length) : NULL;
         }
-        i = scan_until_newline(buffer, i);
-        last = buffer->array[buffer->offset + i];
     }
-    return i;
 }
 
-ushort scan_until_newline(const ReadBuffer* buffer, ushort i)
+/* free_read_buffer: Drops the bytes read but not yet returned, and leaves
+ * buffer empty, as from create_read_buffer().
+ */
+void free_read_buffer(ReadBuffer* buffer)
 {
-    const char* startingPoint = &buffer->array[buffer->offset];
-    for (; i < buffer->length && startingPoint[i] != NEWLINE; i++);
-    return i;
+    mem_free(MEM_PARSE, buffer->array, buffer->capacity);
+    *buffer = create_read_buffer();
 }
 
-void add_newline(ReadBuffer* buffer, ushort i)
+/* fill: Moves the bytes not yet returned to the start of the buffer, then
+ * reads more after them. Returns the number of bytes read, 0 at the end of
+ * the file or on error.
+ */
+size_t fill(ReadBuffer* buffer, int fd)
 {
-    buffer->array[buffer->offset + i] = NEWLINE;
-    buffer->length++;
+    if (buffer->offset)
+    {
+        memmove(buffer->array, &buffer->array[buffer->offset], buffer->length);
+        buffer->offset = 0;
+    }
+    if (reserve(buffer, buffer->length + READLINE_READ_SIZE + 1))
+    {
+        return 0;
+    }
+    ssize_t chars_read;
+    do
+    {
+        chars_read = read(fd, &buffer->array[buffer->length], READLINE_READ_SIZE);
+    } while (chars_read == -1 && errno == EINTR);
+    if (chars_read <= 0)
+    {
+        return 0;
+    }
+    buffer->length += chars_read;
+    return chars_read;
 }
 
-char* pop(ReadBuffer* buffer, ushort n)
+int reserve(ReadBuffer* buffer, size_t capacity)
 {
-    char* line = malloc(n + 1);
-    const char* bufferArray = &buffer->array[buffer->offset];
-    ushort i;
-    for (i = 0; i < n; i++)
+    if (capacity <= buffer->capacity)
     {
-        line[i] = bufferArray[i];
+        return EXIT_SUCCESS;
     }
-    line[i] = 0;
-    offset(buffer, n + 1);
-    return line;
+    size_t new_capacity = buffer->capacity ? buffer->capacity : capacity;
+    while (new_capacity < capacity)
+    {
+        new_capacity *= 2;
+    }
+    char* array = mem_realloc(MEM_PARSE, buffer->array, buffer->capacity, new_capacity);
+    if (!array)
+    {
+        return EXIT_FAILURE;
+    }
+    buffer->array = array;
+    buffer->capacity = new_capacity;
+    return EXIT_SUCCESS;
 }
 
-void offset(ReadBuffer* buffer, ushort n)
+/* pop: Returns the next n bytes, null terminated in place of the newline
+ * that follows them, or of the byte after the last one read.
+ */
+char* pop(ReadBuffer* buffer, size_t n, size_t* length)
 {
-    buffer->offset += n;
-    buffer->length -= n;
+    char* line = &buffer->array[buffer->offset];
+    line[n] = 0;
+    size_t consumed = n < buffer->length ? n + 1 : n;
+    buffer->offset += consumed;
+    buffer->length -= consumed;
+    buffer->scanned = 0;
+    *length = n;
+    return line;
 }
@@ -1,6 +1,24 @@
 #ifndef _READLINE_H
 #define _READLINE_H
 
-char* _readline(int fd);
+#include <stddef.h>
+
+/* The bytes read but not yet returned are array[offset, offset + length).
+ * The first scanned of them are known to hold no newline, so that a long
+ * line read in many pieces is still scanned only once. The buffer grows to
+ * fit the longest line, plus one read and a terminating null.
+ */
+typedef struct s_read_buffer {
+    char* array;
+    size_t capacity;
+    size_t offset;
+    size_t length;
+    size_t scanned;
+} ReadBuffer;
+
+ReadBuffer create_read_buffer();
+char* _readline(ReadBuffer* buffer, int fd);
+char* _readline_view(ReadBuffer* buffer, int fd, size_t* length);
+void free_read_buffer(ReadBuffer* buffer);
 
 #endif
@@ -0,0 +1,65 @@
+#include "decimal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_UINT32_DIGITS 10
+#define ASCII_ZEROS 0x3030303030303030ULL
+
+static int are_digits(uint64_t chunk);
+static uint32_t parse_eight_digits(uint64_t chunk);
+
+/* parse_uint32: Reads length characters that must all be decimal digits,
+ * leading zeros allowed, and fails unless they make a number no larger
+ * than UINT32_MAX. Digits are checked and converted eight at a time, as
+ * one 64-bit word (SWAR): a byte is a digit if both its high nibble is 3
+ * and adding 6 to it leaves its high nibble at 3.
+ */
+int parse_uint32(const char *digits, size_t length, unsigned int *value)
+{
+    while (length > 1 && *digits == '0') {
+        digits++;
+        length--;
+    }
+    if (!length || length > MAX_UINT32_DIGITS) return EXIT_FAILURE;
+    // The first eight digits, right aligned behind zeros if there are fewer.
+    size_t head_length = length < 8 ? length : 8;
+    char head[8];
+    memset(head, '0', 8);
+    memcpy(head + 8 - head_length, digits, head_length);
+    uint64_t chunk;
+    memcpy(&chunk, head, 8);
+    if (!are_digits(chunk)) return EXIT_FAILURE;
+    uint64_t result = parse_eight_digits(chunk);
+    for (size_t i = head_length; i < length; i++) {
+        unsigned int digit = (unsigned char) digits[i] - '0';
+        if (digit > 9) return EXIT_FAILURE;
+        result = result * 10 + digit;
+    }
+    if (result > UINT32_MAX) return EXIT_FAILURE;
+    *value = result;
+    return EXIT_SUCCESS;
+}
+
+int are_digits(uint64_t chunk)
+{
+    return (chunk & 0xF0F0F0F0F0F0F0F0ULL) == ASCII_ZEROS
+           && ((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == ASCII_ZEROS;
+}
+
+/* parse_eight_digits: Combines digits pairwise, then pairs of pairs, then
+ * the two halves: three multiplications instead of eight. chunk holds the
+ * first digit in its lowest byte, as loaded on a little-endian machine;
+ * elsewhere it is byte-swapped first.
+ */
+uint32_t parse_eight_digits(uint64_t chunk)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    chunk = __builtin_bswap64(chunk);
+#endif
+    chunk -= ASCII_ZEROS;
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = ((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))
+             + ((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+    return chunk;
+}
@@ -0,0 +1,8 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <stddef.h>
+
+int parse_uint32(const char *digits, size_t length, unsigned int *value);
+
+#endif
@@ -0,0 +1,57 @@
+#include "histogram.h"
+
+#define SUB_BUCKETS (1UL << HISTOGRAM_SUB_BITS)
+
+static unsigned int get_bucket(unsigned long value);
+static unsigned long get_bucket_end(unsigned int bucket);
+
+void record_value(Histogram *histogram, unsigned long value)
+{
+    histogram->buckets[get_bucket(value)]++;
+    histogram->count++;
+    histogram->total += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/* get_percentile: Returns the largest value the bucket of the given
+ * percentile can hold, or the largest value recorded if smaller, as in the
+ * last bucket, which has no end. 0 if the histogram is empty.
+ */
+unsigned long get_percentile(const Histogram *histogram, double percent)
+{
+    if (!histogram->count) return 0;
+    unsigned long rank = (unsigned long) (percent / 100 * histogram->count + 0.5);
+    if (!rank) rank = 1;
+    unsigned long count = 0;
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_NUM_BUCKETS; bucket++) {
+        count += histogram->buckets[bucket];
+        if (count >= rank && bucket < HISTOGRAM_NUM_BUCKETS - 1) {
+            unsigned long end = get_bucket_end(bucket);
+            return end < histogram->max ? end : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/* get_bucket: Values below SUB_BUCKETS have a bucket each. Above, the
+ * position of the highest bit picks the power of two, and the bits below
+ * it the sub-bucket.
+ */
+unsigned int get_bucket(unsigned long value)
+{
+    if (value < SUB_BUCKETS) return value;
+    unsigned int exponent = 63 - __builtin_clzl(value);
+    if (exponent >= HISTOGRAM_MAX_BITS) return HISTOGRAM_NUM_BUCKETS - 1;
+    unsigned int shift = exponent - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (value >> shift) - SUB_BUCKETS;
+}
+
+unsigned long get_bucket_end(unsigned int bucket)
+{
+    if (bucket < SUB_BUCKETS) return bucket;
+    unsigned int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    unsigned long start = (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+    return start + (1UL << shift) - 1;
+}
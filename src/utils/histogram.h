@@ -0,0 +1,24 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_NUM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/* Log-linear histogram of unsigned values, as in HdrHistogram: each power
+ * of two is split into 2^HISTOGRAM_SUB_BITS equal buckets, so that any
+ * value is known to within about 3%, from 0 up to 2^HISTOGRAM_MAX_BITS,
+ * where larger values are counted. Recording a value costs one bit scan
+ * and one increment. A zeroed Histogram is empty.
+ */
+typedef struct s_histogram {
+    unsigned long count;
+    unsigned long total;
+    unsigned long max;
+    unsigned int buckets[HISTOGRAM_NUM_BUCKETS];
+} Histogram;
+
+void record_value(Histogram *histogram, unsigned long value);
+unsigned long get_percentile(const Histogram *histogram, double percent);
+
+#endif
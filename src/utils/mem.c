@@ -0,0 +1,183 @@
+/* Accounting of the memory the blockchain allocates, by kind, for the mem
+ * command and the -m option:
+ *
+ * - indexes: the node index, the block holders and the sync tallies.
+ * - nodes: the pages of the node pool.
+ * - blocks: block arrays, with their id indexes, and shared sequences.
+ * - parse: the line buffer and the id lists of commands.
+ * - scratch: what sync, rm block and where allocate while they run.
+ *
+ * Callers pass the size of what they free, as each structure knows its own
+ * capacity, so allocations carry no header. I/O buffers are not tracked.
+ *
+ * With a limit set, a charge that would take the total over it fails as
+ * malloc would, so callers leave the blockchain as it was and report
+ * ERROR_ID_NO_RESOURCES. The counters are atomic, as a parallel sync
+ * allocates from several threads.
+ */
+
+#include "mem.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct s_mem_counter {
+    atomic_size_t live;
+    atomic_size_t peak;
+} MemCounter;
+
+static MemCounter counters[NUM_MEM_KINDS];
+static MemCounter total;
+static size_t limit;
+static atomic_size_t num_rejections;
+
+static const char *KIND_NAMES[NUM_MEM_KINDS] = {
+        [MEM_INDEXES] = "indexes",
+        [MEM_NODES] = "nodes",
+        [MEM_BLOCKS] = "blocks",
+        [MEM_PARSE] = "parse",
+        [MEM_SCRATCH] = "scratch"
+};
+
+static int add_within_limit(size_t size);
+static void add_to_counter(MemCounter *counter, size_t size);
+static void raise_peak(MemCounter *counter, size_t live);
+static MemStats read_counter(MemCounter *counter);
+
+/* mem_charge: Counts size more bytes of kind, unless that would go over
+ * the limit.
+ */
+int mem_charge(MemKind kind, size_t size)
+{
+    if (!size) return EXIT_SUCCESS;
+    if (add_within_limit(size)) {
+        atomic_fetch_add_explicit(&num_rejections, 1, memory_order_relaxed);
+        return EXIT_FAILURE;
+    }
+    add_to_counter(&counters[kind], size);
+    return EXIT_SUCCESS;
+}
+
+void mem_uncharge(MemKind kind, size_t size)
+{
+    atomic_fetch_sub_explicit(&counters[kind].live, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&total.live, size, memory_order_relaxed);
+}
+
+void *mem_alloc(MemKind kind, size_t size)
+{
+    if (mem_charge(kind, size)) return NULL;
+    void *ptr = malloc(size);
+    if (!ptr) {
+        mem_uncharge(kind, size);
+    }
+    return ptr;
+}
+
+void *mem_calloc(MemKind kind, size_t count, size_t size)
+{
+    if (size && count > SIZE_MAX / size) return NULL;
+    void *ptr = mem_alloc(kind, count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+/* mem_realloc: As realloc, from an allocation of old_size bytes. On
+ * failure, ptr is still counted as old_size bytes.
+ */
+void *mem_realloc(MemKind kind, void *ptr, size_t old_size, size_t size)
+{
+    if (size > old_size && mem_charge(kind, size - old_size)) return NULL;
+    void *new_ptr = realloc(ptr, size);
+    if (!new_ptr) {
+        if (size > old_size) {
+            mem_uncharge(kind, size - old_size);
+        }
+        return NULL;
+    }
+    if (size < old_size) {
+        mem_uncharge(kind, old_size - size);
+    }
+    return new_ptr;
+}
+
+void mem_free(MemKind kind, void *ptr, size_t size)
+{
+    if (!ptr) return;
+    free(ptr);
+    mem_uncharge(kind, size);
+}
+
+/* set_mem_limit: 0, the default, sets no limit. Only meant to be called
+ * before anything is allocated.
+ */
+void set_mem_limit(size_t new_limit)
+{
+    limit = new_limit;
+}
+
+size_t get_mem_limit()
+{
+    return limit;
+}
+
+size_t get_num_mem_rejections()
+{
+    return atomic_load_explicit(&num_rejections, memory_order_relaxed);
+}
+
+MemStats get_mem_stats(MemKind kind)
+{
+    return read_counter(&counters[kind]);
+}
+
+MemStats get_total_mem_stats()
+{
+    return read_counter(&total);
+}
+
+const char *get_mem_kind_name(MemKind kind)
+{
+    return KIND_NAMES[kind];
+}
+
+/* add_within_limit: Adds size to the total, unless that would take it
+ * over the limit. The total never goes over, even for a moment, so that
+ * its peak does not either.
+ */
+int add_within_limit(size_t size)
+{
+    size_t live = atomic_load_explicit(&total.live, memory_order_relaxed);
+    do {
+        if (limit && (live > limit || size > limit - live)) return EXIT_FAILURE;
+    } while (!atomic_compare_exchange_weak_explicit(&total.live, &live, live + size,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    raise_peak(&total, live + size);
+    return EXIT_SUCCESS;
+}
+
+void add_to_counter(MemCounter *counter, size_t size)
+{
+    size_t live = atomic_fetch_add_explicit(&counter->live, size, memory_order_relaxed) + size;
+    raise_peak(counter, live);
+}
+
+void raise_peak(MemCounter *counter, size_t live)
+{
+    size_t peak = atomic_load_explicit(&counter->peak, memory_order_relaxed);
+    while (live > peak && !atomic_compare_exchange_weak_explicit(&counter->peak, &peak, live,
+                                                                 memory_order_relaxed,
+                                                                 memory_order_relaxed));
+}
+
+MemStats read_counter(MemCounter *counter)
+{
+    MemStats stats = {
+            .live = atomic_load_explicit(&counter->live, memory_order_relaxed),
+            .peak = atomic_load_explicit(&counter->peak, memory_order_relaxed)
+    };
+    return stats;
+}
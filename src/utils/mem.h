@@ -0,0 +1,36 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+
+/* What tracked memory is used for. MEM_INDEXES is zero, so that a zeroed
+ * UintIndex counts as one.
+ */
+typedef enum e_mem_kind {
+    MEM_INDEXES,
+    MEM_NODES,
+    MEM_BLOCKS,
+    MEM_PARSE,
+    MEM_SCRATCH,
+    NUM_MEM_KINDS
+} MemKind;
+
+typedef struct s_mem_stats {
+    size_t live;
+    size_t peak;
+} MemStats;
+
+int mem_charge(MemKind kind, size_t size);
+void mem_uncharge(MemKind kind, size_t size);
+void *mem_alloc(MemKind kind, size_t size);
+void *mem_calloc(MemKind kind, size_t count, size_t size);
+void *mem_realloc(MemKind kind, void *ptr, size_t old_size, size_t size);
+void mem_free(MemKind kind, void *ptr, size_t size);
+void set_mem_limit(size_t limit);
+size_t get_mem_limit();
+size_t get_num_mem_rejections();
+MemStats get_mem_stats(MemKind kind);
+MemStats get_total_mem_stats();
+const char *get_mem_kind_name(MemKind kind);
+
+#endif
@@ -0,0 +1,87 @@
+#include "pool.h"
+#include <stdlib.h>
+#include <stdalign.h>
+
+#define POOL_PAGE_SIZE ((size_t) 64 * 1024)
+
+typedef union u_page_header {
+    void *next;
+    max_align_t align;
+} PageHeader;
+
+static size_t slot_size(const Pool *pool);
+static int add_page(Pool *pool);
+
+void *pool_alloc(Pool *pool)
+{
+    void *object;
+    if (pool->free_list) {
+        object = pool->free_list;
+        pool->free_list = *(void **) object;
+    } else {
+        if (pool->page_cursor == pool->page_end && add_page(pool)) {
+            return NULL;
+        }
+        object = pool->page_cursor;
+        pool->page_cursor += slot_size(pool);
+    }
+    if (++pool->live > pool->peak) {
+        pool->peak = pool->live;
+    }
+    return object;
+}
+
+void pool_free(Pool *pool, void *object)
+{
+    if (!object) return;
+    *(void **) object = pool->free_list;
+    pool->free_list = object;
+    pool->live--;
+}
+
+void pool_release_all(Pool *pool)
+{
+    while (pool->pages) {
+        void *page = pool->pages;
+        pool->pages = ((PageHeader *) page)->next;
+        mem_free(pool->kind, page, POOL_PAGE_SIZE);
+    }
+    pool->page_cursor = pool->page_end = NULL;
+    pool->free_list = NULL;
+    pool->num_pages = 0;
+    pool->live = 0;
+}
+
+PoolStats get_pool_stats(const Pool *pool)
+{
+    PoolStats stats = {
+            .live = pool->live,
+            .peak = pool->peak,
+            .num_pages = pool->num_pages,
+            .bytes = pool->num_pages * POOL_PAGE_SIZE
+    };
+    return stats;
+}
+
+/* slot_size: Every slot must be able to hold the free-list link. Slots are
+ * pointer-aligned, which is all the structs kept in pools need.
+ */
+size_t slot_size(const Pool *pool)
+{
+    size_t size = pool->object_size < sizeof (void *) ? sizeof (void *) : pool->object_size;
+    return (size + alignof (void *) - 1) / alignof (void *) * alignof (void *);
+}
+
+int add_page(Pool *pool)
+{
+    size_t size = slot_size(pool);
+    size_t num_slots = (POOL_PAGE_SIZE - sizeof (PageHeader)) / size;
+    PageHeader *page = mem_alloc(pool->kind, POOL_PAGE_SIZE);
+    if (!page) return EXIT_FAILURE;
+    page->next = pool->pages;
+    pool->pages = page;
+    pool->page_cursor = (char *) (page + 1);
+    pool->page_end = pool->page_cursor + num_slots * size;
+    pool->num_pages++;
+    return EXIT_SUCCESS;
+}
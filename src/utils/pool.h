@@ -0,0 +1,40 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "mem.h"
+#include <stddef.h>
+
+/* Slab allocator for objects of a single type. Objects are carved out of
+ * large pages and recycled through a free list, so allocating and freeing
+ * never reach malloc except to add a page. pool_release_all() drops every
+ * object at once by freeing the pages.
+ *
+ * A pool needs no constructor: a zeroed Pool with object_size set is ready
+ * to use, which lets its owner keep it in a zeroed struct. Its pages are
+ * accounted as memory of the given kind.
+ */
+typedef struct s_pool {
+    size_t object_size;
+    MemKind kind;
+    void *pages;
+    char *page_cursor;
+    char *page_end;
+    void *free_list;
+    size_t num_pages;
+    size_t live;
+    size_t peak;
+} Pool;
+
+typedef struct s_pool_stats {
+    size_t live;
+    size_t peak;
+    size_t num_pages;
+    size_t bytes;
+} PoolStats;
+
+void *pool_alloc(Pool *pool);
+void pool_free(Pool *pool, void *object);
+void pool_release_all(Pool *pool);
+PoolStats get_pool_stats(const Pool *pool);
+
+#endif
@@ -0,0 +1,121 @@
+#include "thread_pool.h"
+#include <stdlib.h>
+
+typedef struct s_worker_start {
+    ThreadPool *pool;
+    size_t worker;
+} WorkerStart;
+
+static void *run_worker(void *arg);
+static void stop_workers(ThreadPool *pool, size_t num_started);
+
+int create_thread_pool(ThreadPool *pool, size_t num_workers)
+{
+    pool->num_workers = num_workers ? num_workers : 1;
+    pool->threads = NULL;
+    pool->task = NULL;
+    pool->arg = NULL;
+    pool->generation = 0;
+    pool->num_running = 0;
+    pool->is_stopping = false;
+    if (pool->num_workers == 1) return EXIT_SUCCESS;
+    pool->threads = malloc((pool->num_workers - 1) * sizeof (pthread_t));
+    if (!pool->threads) {
+        pool->num_workers = 1;
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    for (size_t i = 1; i < pool->num_workers; i++) {
+        WorkerStart *start = malloc(sizeof (WorkerStart));
+        if (start) {
+            start->pool = pool;
+            start->worker = i;
+        }
+        if (!start || pthread_create(&pool->threads[i - 1], NULL, run_worker, start)) {
+            free(start);
+            stop_workers(pool, i - 1);
+            pool->num_workers = 1;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+void run_on_thread_pool(ThreadPool *pool, ThreadPoolTask task, void *arg)
+{
+    if (pool->num_workers == 1) {
+        task(arg, 0);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->num_running = pool->num_workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(arg, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->num_running) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void free_thread_pool(ThreadPool *pool)
+{
+    if (pool->threads) {
+        stop_workers(pool, pool->num_workers - 1);
+    }
+    pool->num_workers = 1;
+}
+
+/* run_worker: Waits for each new generation of work, runs its share, and
+ * reports back. Workers start at generation 0, so that one that is slow to
+ * start still picks up the first run.
+ */
+void *run_worker(void *arg)
+{
+    WorkerStart start = *(WorkerStart *) arg;
+    free(arg);
+    ThreadPool *pool = start.pool;
+    unsigned long generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->is_stopping && pool->generation == generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->is_stopping) break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->task(pool->arg, start.worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (!--pool->num_running) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void stop_workers(ThreadPool *pool, size_t num_started)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->is_stopping = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    pool->threads = NULL;
+}
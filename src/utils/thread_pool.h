@@ -0,0 +1,32 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*ThreadPoolTask)(void *arg, size_t worker);
+
+/* Fixed set of worker threads, started once and reused for every run.
+ * run_on_thread_pool() calls task once per worker, the calling thread
+ * being worker 0, and returns when every call has returned. A pool of one
+ * worker starts no threads and simply calls task.
+ */
+typedef struct s_thread_pool {
+    size_t num_workers;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    ThreadPoolTask task;
+    void *arg;
+    unsigned long generation;
+    size_t num_running;
+    bool is_stopping;
+} ThreadPool;
+
+int create_thread_pool(ThreadPool *pool, size_t num_workers);
+void run_on_thread_pool(ThreadPool *pool, ThreadPoolTask task, void *arg);
+void free_thread_pool(ThreadPool *pool);
+
+#endif
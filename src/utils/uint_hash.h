@@ -0,0 +1,26 @@
+#ifndef UINT_HASH_H
+#define UINT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fibonacci hashing, for the power-of-two tables of UintMap and UintIndex:
+ * multiplies key by 2^32 divided by the golden ratio and keeps the top bits
+ * of the product, which depend on every bit of key. The low bits would
+ * only depend on the low bits of key, so ids a power of two apart would all
+ * land in the same slot. shift comes from uint_hash_shift().
+ */
+static inline size_t uint_hash(unsigned int key, unsigned int shift)
+{
+    return (size_t) ((uint32_t) (key * UINT32_C(2654435769)) >> shift);
+}
+
+/* uint_hash_shift: The shift that makes uint_hash() return the slots of a
+ * table of capacity slots, a power of two no greater than 2^32.
+ */
+static inline unsigned int uint_hash_shift(size_t capacity)
+{
+    return 32 - __builtin_ctzll(capacity);
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "uint_index.h"
+#include "uint_hash.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define UINT_INDEX_MIN_CAPACITY 8
+// Grow once the index would be more than 3/4 full.
+#define UINT_INDEX_MAX_LOAD_NUM 3
+#define UINT_INDEX_MAX_LOAD_DEN 4
+
+static size_t find_slot(const UintIndex *index, unsigned int key);
+static bool is_free(const UintIndexSlot *slot);
+static int grow(UintIndex *index);
+static void shift_back(UintIndex *index, size_t hole);
+
+UintIndex create_uint_index()
+{
+    return create_uint_index_of(MEM_INDEXES);
+}
+
+UintIndex create_uint_index_of(MemKind kind)
+{
+    UintIndex index = {
+            .slots = NULL,
+            .capacity = 0,
+            .size = 0,
+            .kind = kind,
+            .shift = 0
+    };
+    return index;
+}
+
+unsigned int uint_index_get(const UintIndex *index, unsigned int key)
+{
+    if (!index->size) return UINT_INDEX_NONE;
+    return index->slots[find_slot(index, key)].value;
+}
+
+/* uint_index_put: Overwriting the value of a key already in the index
+ * never allocates, so it cannot fail.
+ */
+int uint_index_put(UintIndex *index, unsigned int key, unsigned int value)
+{
+    size_t i = index->capacity ? find_slot(index, key) : 0;
+    if (!index->capacity || is_free(&index->slots[i])) {
+        if ((index->size + 1) * UINT_INDEX_MAX_LOAD_DEN > index->capacity * UINT_INDEX_MAX_LOAD_NUM) {
+            if (grow(index)) return EXIT_FAILURE;
+            i = find_slot(index, key);
+        }
+        index->slots[i].key = key;
+        index->size++;
+    }
+    index->slots[i].value = value;
+    return EXIT_SUCCESS;
+}
+
+unsigned int uint_index_remove(UintIndex *index, unsigned int key)
+{
+    if (!index->size) return UINT_INDEX_NONE;
+    size_t i = find_slot(index, key);
+    unsigned int value = index->slots[i].value;
+    if (value == UINT_INDEX_NONE) return UINT_INDEX_NONE;
+    shift_back(index, i);
+    index->size--;
+    return value;
+}
+
+void free_uint_index(UintIndex *index)
+{
+    mem_free(index->kind, index->slots, index->capacity * sizeof (UintIndexSlot));
+    *index = create_uint_index_of(index->kind);
+}
+
+size_t find_slot(const UintIndex *index, unsigned int key)
+{
+    size_t i = uint_hash(key, index->shift);
+    while (!is_free(&index->slots[i]) && index->slots[i].key != key) {
+        i = (i + 1) & (index->capacity - 1);
+    }
+    return i;
+}
+
+bool is_free(const UintIndexSlot *slot)
+{
+    return slot->value == UINT_INDEX_NONE;
+}
+
+int grow(UintIndex *index)
+{
+    size_t capacity = index->capacity ? index->capacity * 2 : UINT_INDEX_MIN_CAPACITY;
+    UintIndexSlot *slots = mem_alloc(index->kind, capacity * sizeof (UintIndexSlot));
+    if (!slots) return EXIT_FAILURE;
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].value = UINT_INDEX_NONE;
+    }
+    UintIndex grown = {
+            .slots = slots,
+            .capacity = capacity,
+            .size = index->size,
+            .kind = index->kind,
+            .shift = uint_hash_shift(capacity)
+    };
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (!is_free(&index->slots[i])) {
+            grown.slots[find_slot(&grown, index->slots[i].key)] = index->slots[i];
+        }
+    }
+    mem_free(index->kind, index->slots, index->capacity * sizeof (UintIndexSlot));
+    *index = grown;
+    return EXIT_SUCCESS;
+}
+
+void shift_back(UintIndex *index, size_t hole)
+{
+    size_t mask = index->capacity - 1;
+    size_t i = hole;
+    while (true) {
+        index->slots[hole].value = UINT_INDEX_NONE;
+        do {
+            i = (i + 1) & mask;
+            if (is_free(&index->slots[i])) return;
+        } while (((i - uint_hash(index->slots[i].key, index->shift)) & mask)
+                 < ((i - hole) & mask));
+        index->slots[hole] = index->slots[i];
+        hole = i;
+    }
+}
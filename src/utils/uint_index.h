@@ -0,0 +1,34 @@
+#ifndef UINT_INDEX_H
+#define UINT_INDEX_H
+
+#include "mem.h"
+#include <stddef.h>
+
+#define UINT_INDEX_NONE ((unsigned int) -1)
+
+typedef struct s_uint_index_slot {
+    unsigned int key;
+    unsigned int value;
+} UintIndexSlot;
+
+/* Compact counterpart of UintMap for indexing arrays or keeping tallies:
+ * maps unsigned int keys to values below UINT_INDEX_NONE, in 8-byte slots.
+ * A slot is free when its value is UINT_INDEX_NONE. Probing and removal
+ * work as in UintMap. The slots are accounted as memory of the given kind.
+ */
+typedef struct s_uint_index {
+    UintIndexSlot *slots;
+    size_t capacity;
+    size_t size;
+    MemKind kind;
+    unsigned int shift;
+} UintIndex;
+
+UintIndex create_uint_index();
+UintIndex create_uint_index_of(MemKind kind);
+unsigned int uint_index_get(const UintIndex *index, unsigned int key);
+int uint_index_put(UintIndex *index, unsigned int key, unsigned int value);
+unsigned int uint_index_remove(UintIndex *index, unsigned int key);
+void free_uint_index(UintIndex *index);
+
+#endif
@@ -0,0 +1,116 @@
+#include "uint_map.h"
+#include "mem.h"
+#include "uint_hash.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define UINT_MAP_MIN_CAPACITY 8
+// Grow once the map would be more than 3/4 full.
+#define UINT_MAP_MAX_LOAD_NUM 3
+#define UINT_MAP_MAX_LOAD_DEN 4
+
+static size_t find_slot(const UintMap *map, unsigned int key);
+static int grow(UintMap *map);
+static void shift_back(UintMap *map, size_t hole);
+
+UintMap create_uint_map()
+{
+    UintMap map = {
+            .slots = NULL,
+            .capacity = 0,
+            .size = 0,
+            .shift = 0
+    };
+    return map;
+}
+
+void *uint_map_get(const UintMap *map, unsigned int key)
+{
+    if (!map->size) return NULL;
+    return map->slots[find_slot(map, key)].value;
+}
+
+int uint_map_put(UintMap *map, unsigned int key, void *value)
+{
+    if ((map->size + 1) * UINT_MAP_MAX_LOAD_DEN > map->capacity * UINT_MAP_MAX_LOAD_NUM
+            && grow(map)) {
+        return EXIT_FAILURE;
+    }
+    UintMapSlot *slot = &map->slots[find_slot(map, key)];
+    if (!slot->value) {
+        slot->key = key;
+        map->size++;
+    }
+    slot->value = value;
+    return EXIT_SUCCESS;
+}
+
+void *uint_map_remove(UintMap *map, unsigned int key)
+{
+    if (!map->size) return NULL;
+    size_t i = find_slot(map, key);
+    void *value = map->slots[i].value;
+    if (!value) return NULL;
+    shift_back(map, i);
+    map->size--;
+    return value;
+}
+
+void free_uint_map(UintMap *map)
+{
+    mem_free(MEM_INDEXES, map->slots, map->capacity * sizeof (UintMapSlot));
+    *map = create_uint_map();
+}
+
+/* find_slot: Returns the index of the slot holding key, or of the free slot
+ * where key would be inserted. The map must have at least one free slot.
+ */
+size_t find_slot(const UintMap *map, unsigned int key)
+{
+    size_t i = uint_hash(key, map->shift);
+    while (map->slots[i].value && map->slots[i].key != key) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return i;
+}
+
+int grow(UintMap *map)
+{
+    size_t capacity = map->capacity ? map->capacity * 2 : UINT_MAP_MIN_CAPACITY;
+    UintMapSlot *slots = mem_calloc(MEM_INDEXES, capacity, sizeof (UintMapSlot));
+    if (!slots) return EXIT_FAILURE;
+    UintMap grown = {
+            .slots = slots,
+            .capacity = capacity,
+            .size = map->size,
+            .shift = uint_hash_shift(capacity)
+    };
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].value) {
+            grown.slots[find_slot(&grown, map->slots[i].key)] = map->slots[i];
+        }
+    }
+    mem_free(MEM_INDEXES, map->slots, map->capacity * sizeof (UintMapSlot));
+    *map = grown;
+    return EXIT_SUCCESS;
+}
+
+/* shift_back: Backward-shift deletion. Empties the slot at hole, then moves
+ * every later entry of the same probe run that would no longer be reachable
+ * into the hole, so that no tombstones are needed.
+ */
+void shift_back(UintMap *map, size_t hole)
+{
+    size_t mask = map->capacity - 1;
+    size_t i = hole;
+    while (true) {
+        map->slots[hole].value = NULL;
+        do {
+            i = (i + 1) & mask;
+            if (!map->slots[i].value) return;
+        } while (((i - uint_hash(map->slots[i].key, map->shift)) & mask)
+                 < ((i - hole) & mask));
+        map->slots[hole] = map->slots[i];
+        hole = i;
+    }
+}
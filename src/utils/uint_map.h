@@ -0,0 +1,30 @@
+#ifndef UINT_MAP_H
+#define UINT_MAP_H
+
+#include <stddef.h>
+
+typedef struct s_uint_map_slot {
+    unsigned int key;
+    void *value;
+} UintMapSlot;
+
+/* Open-addressing hash map from unsigned int keys to non-NULL pointers.
+ * Collisions are resolved by linear probing; removal shifts the following
+ * entries back instead of leaving tombstones, so lookups never slow down
+ * after many removals. A slot is free when its value is NULL. The slots are
+ * accounted as MEM_INDEXES memory.
+ */
+typedef struct s_uint_map {
+    UintMapSlot *slots;
+    size_t capacity;
+    size_t size;
+    unsigned int shift;
+} UintMap;
+
+UintMap create_uint_map();
+void *uint_map_get(const UintMap *map, unsigned int key);
+int uint_map_put(UintMap *map, unsigned int key, void *value);
+void *uint_map_remove(UintMap *map, unsigned int key);
+void free_uint_map(UintMap *map);
+
+#endif
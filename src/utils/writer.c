@@ -0,0 +1,118 @@
+#include "writer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define WRITER_BUFFER_SIZE (1 << 16)
+// Enough digits for any unsigned long.
+#define MAX_DIGITS 20
+
+// The decimal digits of 0 to 99, two by two.
+static const char DIGIT_PAIRS[] =
+        "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+        "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+static void write_all(Writer *writer, struct iovec *vectors, int num_vectors);
+
+int create_writer(Writer *writer, int fildes)
+{
+    writer->fildes = fildes;
+    writer->buffer = malloc(WRITER_BUFFER_SIZE);
+    writer->length = 0;
+    writer->num_written = 0;
+    writer->status = writer->buffer ? EXIT_SUCCESS : EXIT_FAILURE;
+    return writer->status;
+}
+
+/* write_bytes: Bytes too many to buffer are written along with the buffer,
+ * in a single writev(2).
+ */
+void write_bytes(Writer *writer, const void *bytes, size_t size)
+{
+    if (writer->length + size > WRITER_BUFFER_SIZE) {
+        if (size > WRITER_BUFFER_SIZE) {
+            struct iovec vectors[2] = {
+                    { .iov_base = writer->buffer, .iov_len = writer->length },
+                    { .iov_base = (void *) bytes, .iov_len = size }
+            };
+            write_all(writer, vectors, 2);
+            writer->length = 0;
+            return;
+        }
+        flush_writer(writer);
+    }
+    if (writer->status) return;
+    memcpy(writer->buffer + writer->length, bytes, size);
+    writer->length += size;
+}
+
+void write_char(Writer *writer, char c)
+{
+    if (writer->length == WRITER_BUFFER_SIZE) {
+        flush_writer(writer);
+    }
+    if (writer->status) return;
+    writer->buffer[writer->length++] = c;
+}
+
+/* write_uint: Formats value in decimal, from the last digits backwards,
+ * two at a time, which halves the divisions.
+ */
+void write_uint(Writer *writer, unsigned long value)
+{
+    char digits[MAX_DIGITS];
+    char *first = digits + MAX_DIGITS;
+    while (value >= 100) {
+        first -= 2;
+        memcpy(first, &DIGIT_PAIRS[2 * (value % 100)], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        first -= 2;
+        memcpy(first, &DIGIT_PAIRS[2 * value], 2);
+    } else {
+        *--first = '0' + value;
+    }
+    write_bytes(writer, first, digits + MAX_DIGITS - first);
+}
+
+int flush_writer(Writer *writer)
+{
+    struct iovec vector = { .iov_base = writer->buffer, .iov_len = writer->length };
+    write_all(writer, &vector, 1);
+    writer->length = 0;
+    return writer->status;
+}
+
+void free_writer(Writer *writer)
+{
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->length = 0;
+}
+
+/* write_all: Retries until every vector is written, skipping past what
+ * each short write took.
+ */
+void write_all(Writer *writer, struct iovec *vectors, int num_vectors)
+{
+    while (!writer->status && num_vectors) {
+        ssize_t count = writev(writer->fildes, vectors, num_vectors);
+        if (count < 0) {
+            if (errno != EINTR) writer->status = EXIT_FAILURE;
+            continue;
+        }
+        writer->num_written += count;
+        while (num_vectors && (size_t) count >= vectors->iov_len) {
+            count -= vectors->iov_len;
+            vectors++;
+            num_vectors--;
+        }
+        if (num_vectors) {
+            vectors->iov_base = (char *) vectors->iov_base + count;
+            vectors->iov_len -= count;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+
+/* Buffered output to a file descriptor. Writes are gathered in a large
+ * buffer and handed to writev(2) only when it fills up or is flushed, so
+ * that writing many small pieces costs few system calls. A piece larger
+ * than the buffer goes out in the same call as it. The first failed write
+ * sets status, after which everything is dropped.
+ */
+typedef struct s_writer {
+    int fildes;
+    char *buffer;
+    size_t length;
+    size_t num_written;
+    int status;
+} Writer;
+
+int create_writer(Writer *writer, int fildes);
+void write_bytes(Writer *writer, const void *bytes, size_t size);
+void write_char(Writer *writer, char c);
+void write_uint(Writer *writer, unsigned long value);
+int flush_writer(Writer *writer);
+void free_writer(Writer *writer);
+
+#endif
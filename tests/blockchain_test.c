@@ -1,115 +1,454 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "../src/blockchain/blockchain_public.h"
+#include "../src/blockchain/snapshot.h"
+#include "../src/utils/mem.h"
 
 static void test_blockchain_sample();
+static void test_blockchain_parallel_sync();
+static void test_blockchain_block_holders();
+static void test_blockchain_snapshot();
+static void test_blockchain_snapshot_delta();
+static void test_blockchain_separate_chains();
+static void test_blockchain_memory();
+static void test_blockchain_concurrent_readers();
+static void *check_while_writing(void *arg);
+static unsigned char *write_snapshot_data(const Blockchain *chain, const SnapshotInfo *info,
+                                          size_t *size);
+static unsigned char *read_written_data(FILE *file, size_t *size);
+static void print_nodes_with_block(Blockchain *chain, unsigned int bid);
 static void print_node(const Node *node);
-static void print_blockchain();
+static void print_blockchain(const Blockchain *chain);
+static void print_stats(const Blockchain *chain);
 
 void test_blockchain() {
 	test_blockchain_sample();
+	test_blockchain_parallel_sync();
+	test_blockchain_block_holders();
+	test_blockchain_snapshot();
+	test_blockchain_snapshot_delta();
+	test_blockchain_separate_chains();
+	test_blockchain_concurrent_readers();
+	test_blockchain_memory();
 }
 
 void test_blockchain_sample()
 {
+    Blockchain *chain = new_blockchain();
     printf("%s\n", "Printing empty blockchain; should be empty");
-    print_blockchain();
+    print_blockchain(chain);
 
     printf("%s\n", "Sync empty blockchain");
-    synchronize();
-    print_blockchain();
+    synchronize(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Adding one node");
-    Node *node = new_node(1);
-    add_node(node);
-    print_blockchain();
+    Node *node = new_node(chain, 1);
+    add_node(chain, node);
+    print_blockchain(chain);
 
     printf("%s\n", "Sync blockchain with one empty node");
-    synchronize();
-    print_blockchain();
+    synchronize(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Adding one block to that node");
-    Block *block = new_block(1);
-    add_block(block, node);
-    update_sync_state();
-    print_blockchain();
+    add_block(1, node);
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Sync blockchain twice with one node containing one block");
-    synchronize();
-    print_blockchain();
+    synchronize(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Adding several nodes and several blocks");
-    block = new_block(2);
-    add_block(block, node);
-    update_sync_state();
-    node = new_node(2);
-    add_node(node);
-    block = new_block(3);
-    add_block(block, node);
-    block = new_block(4);
-    add_block(block, node);
-    block = new_block(5);
-    add_block(block, node);
-    block = new_block(6);
-    add_block(block, node);
-    block = new_block(7);
-    add_block(block, node);
-    block = new_block(8);
-    add_block(block, node);
-    update_sync_state();
-    add_node(new_node(3));
-    print_blockchain();
+    add_block(2, node);
+    update_sync_state(chain);
+    node = new_node(chain, 2);
+    add_node(chain, node);
+    add_block(3, node);
+    add_block(4, node);
+    add_block(5, node);
+    add_block(6, node);
+    add_block(7, node);
+    add_block(8, node);
+    update_sync_state(chain);
+    add_node(chain, new_node(chain, 3));
+    print_blockchain(chain);
 
     printf("%s\n", "Remove in middle");
-    node = get_node_from_id(2);
+    node = get_node_from_id(chain, 2);
     rmv_block(get_block_from_id(5, node), node);
-    update_sync_state();
-    print_blockchain();
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Remove head");
     rmv_block(get_block_from_id(3, node), node);
-    update_sync_state();
-    print_blockchain();
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Remove tail");
     rmv_block(get_block_from_id(8, node), node);
-    update_sync_state();
-    print_blockchain();
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Sync blockchain");
-    synchronize();
-    print_blockchain();
+    synchronize(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Add one block to first node");
-    block = new_block(8);
-    add_block(block, get_node_from_id(1));
-    update_sync_state();
-    print_blockchain();
+    add_block(8, get_node_from_id(chain, 1));
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Sync blockchain");
-    synchronize();
-    print_blockchain();
+    synchronize(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Remove middle node");
-    rmv_node(get_node_from_id(2));
-    update_sync_state();
-    print_blockchain();
+    rmv_node(chain, get_node_from_id(chain, 2));
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Remove head node");
-    rmv_node(get_node_from_id(1));
-    update_sync_state();
-    print_blockchain();
+    rmv_node(chain, get_node_from_id(chain, 1));
+    update_sync_state(chain);
+    print_blockchain(chain);
 
     printf("%s\n", "Remove head and tail node (only node)");
-    rmv_node(get_node_from_id(3));
-    update_sync_state();
-    print_blockchain();
+    rmv_node(chain, get_node_from_id(chain, 3));
+    update_sync_state(chain);
+    print_blockchain(chain);
 
-    free_blockchain();
+    printf("%s\n", "Node counts; nothing should be live");
+    print_stats(chain);
+
+    free_blockchain(chain);
+}
+
+void test_blockchain_parallel_sync()
+{
+    Blockchain *chain = new_blockchain();
+    printf("%s\n", "Sync 5 nodes on 3 threads; blocks in order 1, 2, 3, 4, 5, 6");
+    set_sync_threads(chain, 3);
+    for (unsigned int nid = 1; nid <= 5; nid++) {
+        add_node(chain, new_node(chain, nid));
+    }
+    add_block(1, get_node_from_id(chain, 1));
+    add_block(2, get_node_from_id(chain, 1));
+    add_block(3, get_node_from_id(chain, 3));
+    add_block(1, get_node_from_id(chain, 4));
+    add_block(4, get_node_from_id(chain, 4));
+    add_block(5, get_node_from_id(chain, 5));
+    add_block(6, get_node_from_id(chain, 5));
+    update_sync_state(chain);
+    synchronize(chain);
+    update_sync_state(chain);
+    print_blockchain(chain);
+
+    printf("%s\n", "Add one block to last node and sync again");
+    add_block(7, get_node_from_id(chain, 5));
+    update_sync_state(chain);
+    synchronize(chain);
+    update_sync_state(chain);
+    print_blockchain(chain);
+
+    free_blockchain(chain);
+}
+
+void test_blockchain_block_holders()
+{
+    Blockchain *chain = new_blockchain();
+    printf("%s\n", "Block 1 in nodes 1 and 3, block 2 in node 2");
+    for (unsigned int nid = 1; nid <= 3; nid++) {
+        add_node(chain, new_node(chain, nid));
+    }
+    add_block(1, get_node_from_id(chain, 1));
+    add_block(1, get_node_from_id(chain, 3));
+    add_block(2, get_node_from_id(chain, 2));
+    print_nodes_with_block(chain, 1);
+    print_nodes_with_block(chain, 2);
+
+    printf("%s\n", "Sync; both blocks in every node");
+    synchronize(chain);
+    update_sync_state(chain);
+    print_nodes_with_block(chain, 1);
+    print_nodes_with_block(chain, 2);
+
+    printf("%s\n", "Remove block 1 from node 2, then node 3");
+    Node *node = get_node_from_id(chain, 2);
+    rmv_block(get_block_from_id(1, node), node);
+    rmv_node(chain, get_node_from_id(chain, 3));
+    update_sync_state(chain);
+    print_nodes_with_block(chain, 1);
+    print_nodes_with_block(chain, 2);
+
+    free_blockchain(chain);
+}
+
+void test_blockchain_snapshot()
+{
+    Blockchain *chain = new_blockchain();
+    printf("%s\n", "Snapshot of 3 nodes synced on 1, 2, then block 3 added to node 2");
+    for (unsigned int nid = 1; nid <= 3; nid++) {
+        add_node(chain, new_node(chain, nid));
+    }
+    add_block(1, get_node_from_id(chain, 1));
+    add_block(2, get_node_from_id(chain, 3));
+    synchronize(chain);
+    update_sync_state(chain);
+    add_block(3, get_node_from_id(chain, 2));
+    update_sync_state(chain);
+    SnapshotInfo info = {.lineage = 1, .sequence = 0, .is_delta = false};
+    size_t size;
+    unsigned char *data = write_snapshot_data(chain, &info, &size);
+    free_blockchain(chain);
+    chain = new_blockchain();
+
+    printf("%s\n", "Loaded back; not synced until node 2 syncs");
+    printf("Snapshot read: %s\n", read_snapshot(chain, data, size) ? "failure" : "success");
+    printf("Synced: %s\n", blockchain_is_synced(chain) ? "yes" : "no");
+    print_blockchain(chain);
+
+    printf("%s\n", "A truncated snapshot is rejected and loads no node");
+    free_blockchain(chain);
+    chain = new_blockchain();
+    printf("Snapshot read: %s\n", read_snapshot(chain, data, size - 4) ? "failure" : "success");
+    print_blockchain(chain);
+    free_blockchain(chain);
+    free(data);
+}
+
+void test_blockchain_snapshot_delta()
+{
+    Blockchain *chain = new_blockchain();
+    printf("%s\n", "Delta after adding block 4 to node 1, removing node 2, adding node 4");
+    for (unsigned int nid = 1; nid <= 3; nid++) {
+        add_node(chain, new_node(chain, nid));
+        add_block(nid, get_node_from_id(chain, nid));
+    }
+    update_sync_state(chain);
+    SnapshotInfo info = {.lineage = 1, .sequence = 0, .is_delta = false};
+    const unsigned char *data[2];
+    size_t sizes[2];
+    data[0] = write_snapshot_data(chain, &info, &sizes[0]);
+    declare_blockchain_saved(chain);
+    add_block(4, get_node_from_id(chain, 1));
+    rmv_node(chain, get_node_from_id(chain, 2));
+    add_node(chain, new_node(chain, 4));
+    update_sync_state(chain);
+    info = (SnapshotInfo) {.lineage = 1, .sequence = 1, .is_delta = true};
+    data[1] = write_snapshot_data(chain, &info, &sizes[1]);
+    printf("Nodes in delta: %u\n", (unsigned int) data[1][12]);
+    free_blockchain(chain);
+    chain = new_blockchain();
+
+    printf("%s\n", "Base, then delta; node 3 comes from the base");
+    printf("Snapshot read: %s\n", read_snapshot(chain, data[0], sizes[0]) ? "failure" : "success");
+    printf("Snapshot read: %s\n", read_snapshot(chain, data[1], sizes[1]) ? "failure" : "success");
+    print_blockchain(chain);
+    free_blockchain(chain);
+    chain = new_blockchain();
+
+    printf("%s\n", "Both merged into one full snapshot");
+    FILE *file = tmpfile();
+    Writer writer;
+    create_writer(&writer, fileno(file));
+    merge_snapshots(&writer, data, sizes, 2, &info);
+    flush_writer(&writer);
+    free_writer(&writer);
+    size_t size;
+    unsigned char *merged = read_written_data(file, &size);
+    printf("Snapshot read: %s\n", read_snapshot(chain, merged, size) ? "failure" : "success");
+    print_blockchain(chain);
+    free_blockchain(chain);
+    free(merged);
+    free((void *) data[0]);
+    free((void *) data[1]);
 }
 
-void print_blockchain()
+void test_blockchain_separate_chains()
 {
-    Node *node = get_nodes();
+    printf("%s\n", "Two blockchains with the same node ids; only the first is synced");
+    Blockchain *first = new_blockchain();
+    Blockchain *second = new_blockchain();
+    for (unsigned int nid = 1; nid <= 2; nid++) {
+        add_node(first, new_node(first, nid));
+        add_node(second, new_node(second, nid));
+        add_block(nid, get_node_from_id(first, nid));
+        add_block(nid + 10, get_node_from_id(second, nid));
+    }
+    synchronize(first);
+    update_sync_state(first);
+    update_sync_state(second);
+    printf("Synced: %s, %s\n", blockchain_is_synced(first) ? "yes" : "no",
+           blockchain_is_synced(second) ? "yes" : "no");
+    print_blockchain(first);
+
+    printf("%s\n", "The second, once the first is freed");
+    free_blockchain(first);
+    print_blockchain(second);
+    free_blockchain(second);
+}
+
+/* What a reader thread checks while the writer runs: under the read lock,
+ * the nodes listed always add up to num_nodes, and their blocks to
+ * num_blocks, which the writer updates under the write lock.
+ */
+typedef struct s_reader_check {
+    Blockchain *chain;
+    const size_t *num_blocks;
+    atomic_bool *is_done;
+    size_t num_reads;
+    size_t num_inconsistent;
+} ReaderCheck;
+
+#define NUM_READERS 3
+
+void test_blockchain_concurrent_readers()
+{
+    printf("%s\n", "3 readers list the nodes while a writer adds, removes and syncs them");
+    Blockchain *chain = new_blockchain();
+    size_t num_blocks = 0;
+    atomic_bool is_done = false;
+    pthread_t readers[NUM_READERS];
+    ReaderCheck checks[NUM_READERS];
+    for (size_t i = 0; i < NUM_READERS; i++) {
+        checks[i] = (ReaderCheck) {.chain = chain, .num_blocks = &num_blocks,
+                                   .is_done = &is_done};
+        pthread_create(&readers[i], NULL, check_while_writing, &checks[i]);
+    }
+    for (unsigned int nid = 1; nid <= 2000; nid++) {
+        lock_blockchain_for_writing(chain);
+        Node *node = new_node(chain, nid);
+        add_node(chain, node);
+        add_block(nid, node);
+        num_blocks++;
+        if (nid % 3 == 0) {
+            num_blocks -= get_num_blocks(get_node_from_id(chain, nid - 1));
+            rmv_node(chain, get_node_from_id(chain, nid - 1));
+        }
+        if (nid % 500 == 0) {
+            synchronize(chain);
+            num_blocks = 0;
+            for (node = get_nodes(chain); node; node = node->next) {
+                num_blocks += get_num_blocks(node);
+            }
+            num_blocks -= get_num_blocks(get_nodes(chain));
+            rmv_node(chain, get_nodes(chain));
+        }
+        update_sync_state(chain);
+        unlock_blockchain(chain);
+    }
+    atomic_store(&is_done, true);
+    size_t num_inconsistent = 0;
+    bool all_read = true;
+    for (size_t i = 0; i < NUM_READERS; i++) {
+        pthread_join(readers[i], NULL);
+        num_inconsistent += checks[i].num_inconsistent;
+        all_read = all_read && checks[i].num_reads;
+    }
+    printf("Nodes left: %zu\n", get_num_nodes(chain));
+    printf("Every reader read: %s\n", all_read ? "yes" : "no");
+    printf("Inconsistent reads: %zu\n", num_inconsistent);
+    free_blockchain(chain);
+    puts("");
+}
+
+void *check_while_writing(void *arg)
+{
+    ReaderCheck *check = arg;
+    do {
+        lock_blockchain_for_reading(check->chain);
+        size_t num_nodes = 0;
+        size_t num_blocks = 0;
+        for (Node *node = get_nodes(check->chain); node; node = node->next) {
+            num_nodes++;
+            for (Block *block = first_block(node); block; block = next_block(node, block)) {
+                num_blocks++;
+            }
+        }
+        if (num_nodes != get_num_nodes(check->chain) || num_blocks != *check->num_blocks) {
+            check->num_inconsistent++;
+        }
+        blockchain_is_synced(check->chain);
+        unlock_blockchain(check->chain);
+        check->num_reads++;
+    } while (!atomic_load(&check->is_done));
+    return NULL;
+}
+
+/* write_snapshot_data: Returns the snapshot of the blockchain, as info.
+ */
+unsigned char *write_snapshot_data(const Blockchain *chain, const SnapshotInfo *info, size_t *size)
+{
+    FILE *file = tmpfile();
+    Writer writer;
+    create_writer(&writer, fileno(file));
+    write_snapshot(&writer, chain, info);
+    flush_writer(&writer);
+    free_writer(&writer);
+    return read_written_data(file, size);
+}
+
+/* read_written_data: Reads back, then closes, a temporary file written to
+ * through its descriptor.
+ */
+unsigned char *read_written_data(FILE *file, size_t *size)
+{
+    *size = ftell(file);
+    unsigned char *data = malloc(*size);
+    rewind(file);
+    fread(data, 1, *size, file);
+    fclose(file);
+    return data;
+}
+
+void test_blockchain_memory()
+{
+    Blockchain *chain = new_blockchain();
+    printf("%s\n", "Sync, remove and find blocks on 2 threads, then free everything");
+    set_sync_threads(chain, 2);
+    for (unsigned int nid = 1; nid <= 100; nid++) {
+        add_node(chain, new_node(chain, nid));
+        for (unsigned int bid = nid; bid < nid + 20; bid++) {
+            add_block(bid, get_node_from_id(chain, nid));
+        }
+    }
+    synchronize(chain);
+    unsigned int bids[] = {1, 50, 119};
+    size_t num_removed;
+    rmv_blocks_from_all_nodes(chain, bids, 3, &num_removed);
+    print_nodes_with_block(chain, 60);
+    free_blockchain(chain);
+    chain = new_blockchain();
+    for (MemKind kind = 0; kind < NUM_MEM_KINDS; kind++) {
+        if (kind != MEM_PARSE) {
+            printf("%s: %zu bytes live\n", get_mem_kind_name(kind), get_mem_stats(kind).live);
+        }
+    }
+
+    printf("%s\n", "With a limit of 1 byte, new_node fails");
+    set_mem_limit(1);
+    printf("new_node: %s\n", new_node(chain, 1) ? "ok" : "NULL");
+    set_mem_limit(0);
+    free_blockchain(chain);
+    puts("");
+}
+
+void print_nodes_with_block(Blockchain *chain, unsigned int bid)
+{
+    NodeList nodes = create_node_list();
+    find_nodes_with_block(chain, bid, &nodes);
+    printf("Block # %u: %zu nodes\n", bid, nodes.length);
+    free_node_list(&nodes);
+}
+
+void print_blockchain(const Blockchain *chain)
+{
+    Node *node = get_nodes(chain);
     while (node) {
         printf("Node # %u: ", node->id);
         print_node(node);
@@ -121,9 +460,16 @@ void print_blockchain()
 
 void print_node(const Node *node)
 {
-    Block *block = node->head;
+    Block *block = first_block(node);
     while (block) {
         printf("Block # %u, ", block->id);
-        block = block->next;
+        block = next_block(node, block);
     }
 }
+
+void print_stats(const Blockchain *chain)
+{
+    PoolStats nodes = get_node_stats(chain);
+    printf("Nodes: %zu live, %zu peak\n", nodes.live, nodes.peak);
+    puts("");
+}
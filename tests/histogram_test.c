@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include "../src/utils/histogram.h"
+
+static void test_histogram_sample();
+static void print_percentiles(const Histogram *histogram);
+
+void test_histogram() {
+	test_histogram_sample();
+}
+
+void test_histogram_sample()
+{
+    static Histogram histogram;
+
+    printf("%s\n", "Percentiles of an empty histogram; should all be 0");
+    print_percentiles(&histogram);
+
+    printf("%s\n", "Record 0 to 31, one bucket each; should be exact");
+    for (unsigned long value = 0; value < 32; value++) {
+        record_value(&histogram, value);
+    }
+    print_percentiles(&histogram);
+
+    printf("%s\n", "Record 1000 to 100000 by 1000; p50 should be at most 3% above 34000");
+    for (unsigned long value = 1000; value <= 100000; value += 1000) {
+        record_value(&histogram, value);
+    }
+    print_percentiles(&histogram);
+
+    printf("%s\n", "Record a value past the last bucket; p50 should be at most 3% above 35000, max exact");
+    record_value(&histogram, 1UL << 45);
+    print_percentiles(&histogram);
+    puts("");
+}
+
+void print_percentiles(const Histogram *histogram)
+{
+    printf("count: %lu, p50: %lu, p99: %lu, max: %lu\n", histogram->count,
+           get_percentile(histogram, 50), get_percentile(histogram, 99),
+           get_percentile(histogram, 100));
+}
@@ -3,6 +3,9 @@
 int main()
 {
 	test_blockchain();
+	test_uint_map();
+	test_uint_index();
+	test_histogram();
 
 	return(0);
 }
@@ -2,5 +2,8 @@
 #define MY_BLOCKCHAIN_TEST_H
 
 void test_blockchain();
+void test_uint_map();
+void test_uint_index();
+void test_histogram();
 
 #endif
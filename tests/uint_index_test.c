@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include "../src/utils/uint_hash.h"
+#include "../src/utils/uint_index.h"
+
+#define NUM_KEYS 1000
+#define NUM_STRIDED_KEYS 50000
+#define MAX_PROBE_LENGTH 16
+
+static void test_uint_index_sample();
+static void test_uint_index_strided_keys();
+static size_t get_max_probe_length(const UintIndex *index);
+static void print_lookup(const UintIndex *index, unsigned int key);
+
+void test_uint_index() {
+	test_uint_index_sample();
+	test_uint_index_strided_keys();
+}
+
+void test_uint_index_sample()
+{
+    UintIndex index = create_uint_index();
+
+    printf("%s\n", "Lookup in empty index; should be absent");
+    print_lookup(&index, 0);
+
+    printf("%s\n", "Insert keys 0 to 999, multiples of 8, each to its key divided by 8");
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+        uint_index_put(&index, i * 8, i);
+    }
+    printf("size: %zu\n", index.size);
+    print_lookup(&index, 0);
+    print_lookup(&index, 4000);
+    print_lookup(&index, 7993);
+
+    printf("%s\n", "Remove every other key; the rest should still be found");
+    for (unsigned int i = 0; i < NUM_KEYS; i += 2) {
+        uint_index_remove(&index, i * 8);
+    }
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+        found += uint_index_get(&index, i * 8) != UINT_INDEX_NONE;
+    }
+    printf("size: %zu, found: %u\n", index.size, found);
+    print_lookup(&index, 0);
+    print_lookup(&index, 8);
+
+    free_uint_index(&index);
+    puts("");
+}
+
+/* Keys a power of two apart share all their low bits, so a hash that only
+ * depends on those would send them all to one slot.
+ */
+void test_uint_index_strided_keys()
+{
+    UintIndex index = create_uint_index();
+
+    printf("Insert %u keys 2^16 apart; the longest probe should be at most %u\n",
+           NUM_STRIDED_KEYS, MAX_PROBE_LENGTH);
+    for (unsigned int i = 0; i < NUM_STRIDED_KEYS; i++) {
+        uint_index_put(&index, i << 16, i);
+    }
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < NUM_STRIDED_KEYS; i++) {
+        found += uint_index_get(&index, i << 16) == i;
+    }
+    size_t max_probe_length = get_max_probe_length(&index);
+    printf("size: %zu, found: %u\n", index.size, found);
+    printf("Longest probe at most %u: %s\n", MAX_PROBE_LENGTH,
+           max_probe_length <= MAX_PROBE_LENGTH ? "yes" : "no");
+
+    free_uint_index(&index);
+    puts("");
+}
+
+/* get_max_probe_length: The number of slots the lookup of a key present in
+ * index goes through, at most.
+ */
+size_t get_max_probe_length(const UintIndex *index)
+{
+    size_t max_length = 0;
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->slots[i].value == UINT_INDEX_NONE) continue;
+        size_t length = ((i - uint_hash(index->slots[i].key, index->shift)) & (index->capacity - 1)) + 1;
+        if (length > max_length) {
+            max_length = length;
+        }
+    }
+    return max_length;
+}
+
+void print_lookup(const UintIndex *index, unsigned int key)
+{
+    unsigned int value = uint_index_get(index, key);
+    if (value != UINT_INDEX_NONE) {
+        printf("Key %u -> %u\n", key, value);
+    } else {
+        printf("Key %u absent\n", key);
+    }
+}
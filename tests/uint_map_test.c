@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include "../src/utils/uint_hash.h"
+#include "../src/utils/uint_map.h"
+
+#define NUM_KEYS 1000
+#define NUM_STRIDED_KEYS 50000
+#define MAX_PROBE_LENGTH 16
+
+static void test_uint_map_sample();
+static void test_uint_map_strided_keys();
+static size_t get_max_probe_length(const UintMap *map);
+static void print_lookup(const UintMap *map, unsigned int key);
+
+void test_uint_map() {
+	test_uint_map_sample();
+	test_uint_map_strided_keys();
+}
+
+void test_uint_map_sample()
+{
+    static unsigned int values[NUM_KEYS];
+    UintMap map = create_uint_map();
+
+    printf("%s\n", "Lookup in empty map; should be absent");
+    print_lookup(&map, 0);
+
+    printf("%s\n", "Insert keys 0 to 999, multiples of 8 to force collisions");
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+        values[i] = i * 8;
+        uint_map_put(&map, i * 8, &values[i]);
+    }
+    printf("size: %zu\n", map.size);
+    print_lookup(&map, 0);
+    print_lookup(&map, 4000);
+    print_lookup(&map, 7992);
+    print_lookup(&map, 7993);
+
+    printf("%s\n", "Remove every other key; the rest should still be found");
+    for (unsigned int i = 0; i < NUM_KEYS; i += 2) {
+        uint_map_remove(&map, i * 8);
+    }
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+        found += uint_map_get(&map, i * 8) != NULL;
+    }
+    printf("size: %zu, found: %u\n", map.size, found);
+    print_lookup(&map, 0);
+    print_lookup(&map, 8);
+
+    printf("%s\n", "Overwrite key 8");
+    uint_map_put(&map, 8, &values[0]);
+    printf("size: %zu\n", map.size);
+    print_lookup(&map, 8);
+
+    free_uint_map(&map);
+    puts("");
+}
+
+/* Keys a power of two apart share all their low bits, so a hash that only
+ * depends on those would send them all to one slot.
+ */
+void test_uint_map_strided_keys()
+{
+    UintMap map = create_uint_map();
+
+    printf("Insert %u keys 2^16 apart; the longest probe should be at most %u\n",
+           NUM_STRIDED_KEYS, MAX_PROBE_LENGTH);
+    for (unsigned int i = 0; i < NUM_STRIDED_KEYS; i++) {
+        uint_map_put(&map, i << 16, &map);
+    }
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < NUM_STRIDED_KEYS; i++) {
+        found += uint_map_get(&map, i << 16) != NULL;
+    }
+    size_t max_probe_length = get_max_probe_length(&map);
+    printf("size: %zu, found: %u\n", map.size, found);
+    printf("Longest probe at most %u: %s\n", MAX_PROBE_LENGTH,
+           max_probe_length <= MAX_PROBE_LENGTH ? "yes" : "no");
+
+    free_uint_map(&map);
+    puts("");
+}
+
+/* get_max_probe_length: The number of slots the lookup of a key present in
+ * map goes through, at most.
+ */
+size_t get_max_probe_length(const UintMap *map)
+{
+    size_t max_length = 0;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (!map->slots[i].value) continue;
+        size_t length = ((i - uint_hash(map->slots[i].key, map->shift)) & (map->capacity - 1)) + 1;
+        if (length > max_length) {
+            max_length = length;
+        }
+    }
+    return max_length;
+}
+
+void print_lookup(const UintMap *map, unsigned int key)
+{
+    unsigned int *value = uint_map_get(map, key);
+    if (value) {
+        printf("Key %u -> %u\n", key, *value);
+    } else {
+        printf("Key %u absent\n", key);
+    }
+}